@@ -2,24 +2,28 @@
 
 bool IsFileArchX64(std::filesystem::path path, bool* parsed = nullptr);
 
-template<size_t BitSize>
-IVMPImportFixer* VifFactory_GenerateFixer(std::string_view vmpsn) noexcept
-{
-	return new VMPImportFixer<BitSize>(vmpsn);
-}
-
 int main(int argc, const char** argv)
 {
-	logger = spdlog::stdout_color_mt("console");
+	//
+	// Console output goes through a bounded queue and is written by spdlog's thread, so per-site lines never
+	// wait on the console. A full queue blocks rather than dropping lines. Anything queued is flushed on exit.
+	spdlog::init_thread_pool(8192, 1);
+	logger = spdlog::create_async<spdlog::sinks::stdout_color_sink_mt>("console");
 	logger->set_level(spdlog::level::debug);
 	logger->set_pattern("[%^%l%$] %v");
+	std::atexit([] { spdlog::shutdown(); });
 
 	if (argc > 1)
 	{
 		std::string_view sFilePathOrProc {};
 		std::string_view sTargetModule {};
-		std::string_view sVMPSectionName { ".vmp0" };
+		std::string_view sSnapshotPath {};
+		std::string_view sPipeName {};
+		std::size_t		 nJobThreads { 0 };
 		DWORD			 dwProcessId { 0ul };
+		VifOptions_t	 options {};
+		std::vector<std::string> vecImageFiles {};
+		std::vector<std::string> vecDumpFiles {};
 
 		//
 		// Parse out arguments
@@ -70,11 +74,182 @@ int main(int argc, const char** argv)
 
 			if (_stricmp(argv[i], "-section") == 0 && (i + 1) < argc)
 			{
-				sVMPSectionName = argv[++i];
+				options.section_names.emplace_back(argv[++i]);
+			}
+
+			if (_stricmp(argv[i], "-threads") == 0 && (i + 1) < argc)
+			{
+				options.workers = std::atoi(argv[++i]);
+			}
+
+			if (_stricmp(argv[i], "-all") == 0)
+			{
+				options.fix_all = true;
+			}
+
+			if (_stricmp(argv[i], "-cache") == 0 && (i + 1) < argc)
+			{
+				options.cache_path = argv[++i];
+			}
+
+			if (_stricmp(argv[i], "-budget") == 0 && (i + 1) < argc)
+			{
+				options.instruction_budget = std::strtoull(argv[++i], nullptr, 10);
+			}
+
+			if (_stricmp(argv[i], "-timeout") == 0 && (i + 1) < argc)
+			{
+				options.time_budget_ms = std::strtoull(argv[++i], nullptr, 10);
+			}
+
+			if (_stricmp(argv[i], "-nofast") == 0)
+			{
+				options.fast_path = false;
+			}
+
+			if (_stricmp(argv[i], "-verify") == 0)
+			{
+				options.verify_fast_path = true;
+			}
+
+			if (_stricmp(argv[i], "-v") == 0 && (i + 1) < argc)
+			{
+				spdlog::level::level_enum level = spdlog::level::from_str(argv[++i]);
+
+				//
+				// from_str falls back to off for anything it doesn't know.
+				if (level == spdlog::level::off && _stricmp(argv[i], "off") != 0)
+				{
+					logger->critical("Invalid log level '{}'", argv[i]);
+					return EXIT_FAILURE;
+				}
+
+				logger->set_level(level);
+			}
+
+			if (_stricmp(argv[i], "-quiet") == 0)
+			{
+				logger->set_level(spdlog::level::info);
+			}
+
+			if (_stricmp(argv[i], "-sitelog") == 0 && (i + 1) < argc)
+			{
+				options.site_log_path = argv[++i];
+			}
+
+			if (_stricmp(argv[i], "-metrics") == 0 && (i + 1) < argc)
+			{
+				options.metrics_path = argv[++i];
+			}
+
+			if (_stricmp(argv[i], "-o") == 0 && (i + 1) < argc)
+			{
+				options.output_dir = argv[++i];
+			}
+
+			if (_stricmp(argv[i], "-snapshot") == 0 && (i + 1) < argc)
+			{
+				sSnapshotPath = argv[++i];
+			}
+
+			if (_stricmp(argv[i], "-image") == 0 && (i + 1) < argc)
+			{
+				vecImageFiles.emplace_back(argv[++i]);
 			}
+
+			if (_stricmp(argv[i], "-dump") == 0 && (i + 1) < argc)
+			{
+				vecDumpFiles.emplace_back(argv[++i]);
+			}
+
+			if (_stricmp(argv[i], "-serve") == 0 && (i + 1) < argc)
+			{
+				sPipeName = argv[++i];
+			}
+
+			if (_stricmp(argv[i], "-jobs") == 0 && (i + 1) < argc)
+			{
+				nJobThreads = std::atoi(argv[++i]);
+			}
+		}
+
+		if (!sPipeName.empty())
+		{
+			//
+			// Jobs come in over the pipe, everything else given here is what each job starts out with.
+			VifDaemon daemon(sPipeName, nJobThreads, options);
+
+			return daemon.Run() ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+
+		if (!vecImageFiles.empty())
+		{
+			//
+			// Build a snapshot out of image files, so they can be fixed (and timed) without a process.
+			if (sSnapshotPath.empty())
+			{
+				logger->critical("-image needs a -snapshot file to write to");
+				return EXIT_FAILURE;
+			}
+
+			if (!vif::Snapshot::CaptureImages(vecImageFiles, sSnapshotPath))
+			{
+				logger->critical("Unable to build snapshot {}", sSnapshotPath);
+				return EXIT_FAILURE;
+			}
+
+			logger->info("Built snapshot {} from {} images", sSnapshotPath, vecImageFiles.size());
+			return EXIT_SUCCESS;
+		}
+
+		if (!vecDumpFiles.empty())
+		{
+			//
+			// Raw dumps taken by another tool, read from the files as the snapshot is written.
+			if (sSnapshotPath.empty())
+			{
+				logger->critical("-dump needs a -snapshot file to write to");
+				return EXIT_FAILURE;
+			}
+
+			if (!vif::Snapshot::CaptureDumps(vecDumpFiles, sSnapshotPath))
+			{
+				logger->critical("Unable to build snapshot {}", sSnapshotPath);
+				return EXIT_FAILURE;
+			}
+
+			logger->info("Built snapshot {} from {} dumps", sSnapshotPath, vecDumpFiles.size());
+			return EXIT_SUCCESS;
 		}
 
-		if (!sFilePathOrProc.empty() && std::filesystem::exists(sFilePathOrProc))
+		if (!sFilePathOrProc.empty() && vif::Snapshot::IsSnapshotFile(sFilePathOrProc))
+		{
+			IVMPImportFixer* pImportFixer = nullptr;
+			vif::Snapshot snapshot;
+
+			if (!snapshot.Open(sFilePathOrProc))
+			{
+				logger->critical("Unable to map snapshot {}", sFilePathOrProc);
+				return EXIT_FAILURE;
+			}
+
+			if (snapshot.GetBitSize() == 32)
+				pImportFixer = VifFactory_GenerateFixer<32>(options);
+			else
+				pImportFixer = VifFactory_GenerateFixer<64>(options);
+
+			std::filesystem::create_directories(options.output_dir);
+
+			//
+			// Nothing patched is a failure, the same as the daemon reports it.
+			bool bFixed = pImportFixer->DumpFromSnapshot(snapshot, sTargetModule);
+
+			delete pImportFixer;
+			pImportFixer = nullptr;
+
+			return bFixed ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		else if (!sFilePathOrProc.empty() && std::filesystem::exists(sFilePathOrProc))
 		{
 			bool bWasParsed = false;
 			bool bIsArchX64 = IsFileArchX64(sFilePathOrProc, &bWasParsed);
@@ -99,22 +274,35 @@ int main(int argc, const char** argv)
 					return EXIT_FAILURE;
 				}
 				
+				if (!sSnapshotPath.empty())
+				{
+					//
+					// Only capture, the snapshot can be fixed later (and repeatedly) with -f.
+					if (!vif::Snapshot::Capture(hProcess, sSnapshotPath))
+					{
+						logger->critical("Unable to capture snapshot to {}", sSnapshotPath);
+						return EXIT_FAILURE;
+					}
+
+					logger->info("Captured snapshot to {}", sSnapshotPath);
+					return EXIT_SUCCESS;
+				}
+
 				IsWow64Process(hProcess, &bIsWow64);
 
 				if (bIsWow64)
-					pImportFixer = VifFactory_GenerateFixer<32>(sVMPSectionName);
+					pImportFixer = VifFactory_GenerateFixer<32>(options);
 				else
-					pImportFixer = VifFactory_GenerateFixer<64>(sVMPSectionName);
-
-				std::filesystem::create_directories("dumps");
+					pImportFixer = VifFactory_GenerateFixer<64>(options);
 
-				pImportFixer->DumpInMemory(hProcess, sTargetModule);
+				std::filesystem::create_directories(options.output_dir);
 
+				bool bFixed = pImportFixer->DumpInMemory(hProcess, sTargetModule);
 
 				delete pImportFixer;
 				pImportFixer = nullptr;
 
-				return EXIT_SUCCESS;
+				return bFixed ? EXIT_SUCCESS : EXIT_FAILURE;
 			}
 
 			logger->critical("Invalid process!");
@@ -127,12 +315,38 @@ int main(int argc, const char** argv)
 			"Usage: \tVMPImportFixer\n  -proc \t(required) process name/process id" <<
 			std::endl;
 		std::cout << "  -mod: \t(optional) names of module to dump." << std::endl;
-		std::cout << "  -section: \t(optional) VMP section name to use if changed from default (VMP allows custom names)" << std::endl;
+		std::cout << "  -section: \t(optional, repeatable) VMP section name(s) to use if changed from default .vmp0 (VMP allows custom names)" << std::endl;
+		std::cout << "  -threads: \t(optional) number of emulation threads (defaults to one per core)" << std::endl;
+		std::cout << "  -all: \t(optional) fix every module with a VMP section, each is written to its own .fixed file" << std::endl;
+		std::cout << "  -cache: \t(optional) file to keep stub resolutions in across runs, known stubs aren't emulated again" << std::endl;
+		std::cout << "  -budget: \t(optional) instructions a single stub may run (defaults to one picked from the stubs seen so far)" << std::endl;
+		std::cout << "  -timeout: \t(optional) milliseconds a single stub may run (defaults to one picked from the stubs seen so far)" << std::endl;
+		std::cout << "  -nofast: \t(optional) run every stub through Unicorn, skipping the micro emulator" << std::endl;
+		std::cout << "  -verify: \t(optional) also run Unicorn on stubs the micro emulator resolved, and log any difference" << std::endl;
+		std::cout << "  -v: \t\t(optional) log level: trace, debug (default), info, warning, error, critical or off" << std::endl;
+		std::cout << "  -quiet: \t(optional) only log summaries, not every call site (same as -v info)" << std::endl;
+		std::cout << "  -sitelog: \t(optional) write one JSON line per call site to this file" << std::endl;
+		std::cout << "  -metrics: \t(optional) write phase timings, counters and per stub histograms to this file as JSON" << std::endl;
+		std::cout << "  -o: \t\t(optional) directory the fixed images are written to (defaults to dumps)" << std::endl;
+		std::cout << "  -snapshot: \t(optional) capture the process into a snapshot file instead of fixing it" << std::endl;
+		std::cout << "  -image: \t(optional, repeatable) build the -snapshot file out of image files on disk instead of a process" << std::endl;
+		std::cout << "  -dump: \t(optional, repeatable) build the -snapshot file out of raw memory dumps of modules instead of a process" << std::endl;
+		std::cout << "  -f: \t\t(optional) fix a previously captured snapshot file instead of a live process" << std::endl;
+		std::cout << "  -serve: \t(optional) run as a daemon taking fix jobs on the named pipe \\\\.\\pipe\\<name>" << std::endl;
+		std::cout << "  -jobs: \t(optional) number of jobs the daemon runs at once (defaults to 2)" << std::endl;
 		
 		std::cout <<
 			"Example usages:\n"
 			"*\tVMPImportFixer -p 'test.exe'\n" <<
 			"*\tVMPImportFixer -p 123456 -mod vmp.dll -section .name0\n" <<
+			"*\tVMPImportFixer -p 'test.exe' -section .vmp0 -section .vmp1\n" <<
+			"*\tVMPImportFixer -p 'test.exe' -snapshot test.vifs\n" <<
+			"*\tVMPImportFixer -f test.vifs -mod vmp.dll\n" <<
+			"*\tVMPImportFixer -p 'test.exe' -all\n" <<
+			"*\tVMPImportFixer -image test.exe -image dep.dll -snapshot test.vifs\n" <<
+			"*\tVMPImportFixer -dump test.exe.bin -dump dep.dll.bin -snapshot test.vifs\n" <<
+			"*\tVMPImportFixer -f test.vifs -all -metrics run.json\n" <<
+			"*\tVMPImportFixer -serve vif -jobs 4 -quiet\n" <<
 			std::endl;
 
 		std::cout << std::endl;
@@ -0,0 +1,160 @@
+#include "VIFCallScanner.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <thread>
+#include <emmintrin.h>
+
+namespace
+{
+	//! Chunks smaller than this aren't worth a thread.
+	constexpr std::size_t MIN_CHUNK_SIZE = 0x100000;
+
+	//! Call sites starting in [begin, end), `last` is the last offset a call can start at in its code range.
+	struct ScanChunk_t
+	{
+		std::size_t begin;
+		std::size_t end;
+		std::size_t last;
+	};
+
+	//! Check a single E8 at `pos`, which has to be followed by at least 4 bytes inside of the code range.
+	inline void CheckCallSite(const VifCallScanRange_t& range, std::size_t pos, std::vector<VifImportCall_t>& calls)
+	{
+		std::int32_t rel32;
+		std::memcpy(&rel32, range.image + pos + 1, sizeof(rel32));
+
+		std::int64_t target = static_cast<std::int64_t>(pos) + 5 + rel32;
+
+		//
+		// There are rarely more than a couple of target ranges, a linear search beats anything smarter.
+		if (std::none_of(range.targets.begin(), range.targets.end(), [target](const VifRvaRange_t& r) { return target >= r.begin && target < r.end; }))
+			return;
+
+		std::uint8_t uNextByte = pos + 5 < range.image_size ? range.image[pos + 5] : 0;
+
+		calls.push_back({ static_cast<std::uint32_t>(pos), range.image_base + static_cast<std::uint64_t>(target),
+			(uNextByte == 0xcc || uNextByte == 0xc3) ? VifCallVariant::CallRet : VifCallVariant::PushCall });
+	}
+
+	//! Scan call sites starting in [begin, end), `last` is the last offset a call can start at.
+	void ScanChunk(const VifCallScanRange_t& range, std::size_t begin, std::size_t end, std::size_t last, std::vector<VifImportCall_t>& calls)
+	{
+		const __m128i vecOpcode = _mm_set1_epi8(static_cast<char>(0xe8));
+		std::size_t pos = begin;
+
+		end = std::min(end, last + 1);
+
+		//
+		// 16 offsets at a time, only E8 bytes make it to the rel32 check.
+		for (; pos + 16 <= end; pos += 16)
+		{
+			std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_epi8(
+				_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(range.image + pos)), vecOpcode)));
+
+			while (mask)
+			{
+				CheckCallSite(range, pos + std::countr_zero(mask), calls);
+				mask &= mask - 1;
+			}
+		}
+
+		for (; pos < end; ++pos)
+		{
+			if (range.image[pos] == 0xe8)
+				CheckCallSite(range, pos, calls);
+		}
+	}
+}
+
+std::vector<VifImportCall_t> VifFindImportCalls(const VifCallScanRange_t& range, std::size_t workers)
+{
+	std::vector<VifImportCall_t> calls{};
+
+	if (range.image == nullptr || range.targets.empty())
+		return calls;
+
+	//
+	// Sort the code ranges and merge those that overlap, so no offset is scanned twice.
+	std::vector<VifRvaRange_t> vecCode;
+
+	for (const VifRvaRange_t& code : range.code)
+	{
+		std::uint32_t end = static_cast<std::uint32_t>(std::min<std::size_t>(code.end, range.image_size));
+
+		if (code.begin + 5 <= end)
+			vecCode.push_back({ code.begin, end });
+	}
+
+	std::sort(vecCode.begin(), vecCode.end(), [](const VifRvaRange_t& a, const VifRvaRange_t& b) { return a.begin < b.begin; });
+
+	std::vector<VifRvaRange_t> vecMerged;
+
+	for (const VifRvaRange_t& code : vecCode)
+	{
+		if (!vecMerged.empty() && code.begin <= vecMerged.back().end)
+			vecMerged.back().end = std::max(vecMerged.back().end, code.end);
+		else
+			vecMerged.push_back(code);
+	}
+
+	if (vecMerged.empty())
+		return calls;
+
+	if (workers == 0)
+		workers = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+	//
+	// One chunk size for every range, picked so there is about one chunk per worker in total. Big ranges
+	// get split, small ones stay whole, and the chunks of every range go into the same queue.
+	std::size_t nTotal = 0;
+
+	for (const VifRvaRange_t& code : vecMerged)
+		nTotal += code.end - code.begin;
+
+	std::size_t nChunkSize = std::max((nTotal + workers - 1) / workers, MIN_CHUNK_SIZE);
+	std::vector<ScanChunk_t> vecChunks;
+
+	for (const VifRvaRange_t& code : vecMerged)
+	{
+		for (std::size_t begin = code.begin; begin < code.end; begin += nChunkSize)
+			vecChunks.push_back({ begin, std::min<std::size_t>(begin + nChunkSize, code.end), code.end - 5ull });
+	}
+
+	//
+	// Each chunk collects its own hits, so memory scales with the hits and not with the sections.
+	std::vector<std::vector<VifImportCall_t>> vecChunkCalls(vecChunks.size());
+	std::vector<std::thread> vecWorkers;
+	std::atomic<std::size_t> nNext{ 0 };
+
+	auto Worker = [&]
+	{
+		for (std::size_t i = nNext++; i < vecChunks.size(); i = nNext++)
+			ScanChunk(range, vecChunks[i].begin, vecChunks[i].end, vecChunks[i].last, vecChunkCalls[i]);
+	};
+
+	for (std::size_t i = 1; i < std::min(workers, vecChunks.size()); ++i)
+		vecWorkers.emplace_back(Worker);
+
+	Worker();
+
+	for (auto& worker : vecWorkers)
+		worker.join();
+
+	//
+	// Chunks are in order, so concatenating keeps the calls sorted. An E8 inside of the rel32 of a
+	// call that was already taken can't be a call itself.
+	for (auto& vecChunk : vecChunkCalls)
+	{
+		for (auto& call : vecChunk)
+		{
+			if (!calls.empty() && call.offset < calls.back().offset + 5)
+				continue;
+
+			calls.push_back(call);
+		}
+	}
+
+	return calls;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! The two shapes VMP emits for an import call, stubs adjust the return address differently for each.
+enum class VifCallVariant : std::uint8_t
+{
+	//! push reg; call stub
+	PushCall,
+	//! call stub; ret/int3
+	CallRet
+};
+
+//! A call site in the target that leads into the VMP section.
+struct VifImportCall_t
+{
+	//! Offset of the E8 in the target image
+	std::uint32_t offset;
+	//! Virtual address of the stub the call leads to
+	std::uint64_t destination;
+	VifCallVariant variant;
+};
+
+//! A [begin, end) range of RVAs
+struct VifRvaRange_t
+{
+	std::uint32_t begin;
+	std::uint32_t end;
+};
+
+//! Where to look for calls, all offsets are into `image` (a mapped image, so offsets are RVAs).
+struct VifCallScanRange_t
+{
+	const std::uint8_t*			image;
+	std::size_t					image_size;
+	std::uint64_t				image_base;
+	//! Ranges holding the calls, e.g every executable section
+	std::vector<VifRvaRange_t>	code;
+	//! Ranges the calls have to lead into, e.g every VMP section
+	std::vector<VifRvaRange_t>	targets;
+};
+
+//! Find every `call rel32` in the code ranges that leads into one of the target ranges, in a single pass.
+//! - Targets are computed straight from the rel32, anything leading elsewhere is dropped before it is stored.
+//! - Every code range is split into chunks, and the chunks of all ranges are shared out between `workers`
+//!   threads (0 uses one per hardware thread). A large image takes about as long as its largest range, or less.
+//! - returns the calls sorted by offset, each call only once even if code ranges overlap.
+std::vector<VifImportCall_t> VifFindImportCalls(const VifCallScanRange_t& range, std::size_t workers = 0);
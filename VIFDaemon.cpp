@@ -0,0 +1,495 @@
+#include "VMPImportFixer.hpp"
+
+namespace
+{
+	constexpr DWORD PIPE_BUFFER_SIZE = 0x10000;
+
+	//! Pipes are opened for overlapped I/O, so a read waiting on the client doesn't hold up replies on the same pipe.
+	//! `io` starts the operation, which is then waited on.
+	template<typename Fn>
+	bool PipeIo(HANDLE pipe, DWORD& transferred, Fn io)
+	{
+		vif::nt::ScopedHandle event(CreateEventA(nullptr, TRUE, FALSE, nullptr));
+		OVERLAPPED ov{};
+
+		if (event == INVALID_HANDLE_VALUE)
+			return false;
+
+		ov.hEvent = event;
+
+		if (!io(&ov) && GetLastError() != ERROR_IO_PENDING)
+			return false;
+
+		return GetOverlappedResult(pipe, &ov, &transferred, TRUE) != FALSE;
+	}
+
+	//! Wait for a client on a pipe instance
+	bool ConnectPipe(HANDLE pipe)
+	{
+		vif::nt::ScopedHandle event(CreateEventA(nullptr, TRUE, FALSE, nullptr));
+		OVERLAPPED ov{};
+		DWORD dwUnused = 0;
+
+		if (event == INVALID_HANDLE_VALUE)
+			return false;
+
+		ov.hEvent = event;
+
+		if (ConnectNamedPipe(pipe, &ov))
+			return true;
+
+		switch (GetLastError())
+		{
+		//
+		// A client that connected in between creating and connecting is already there.
+		case ERROR_PIPE_CONNECTED:
+			return true;
+		case ERROR_IO_PENDING:
+			return GetOverlappedResult(pipe, &ov, &dwUnused, TRUE) != FALSE;
+		default:
+			return false;
+		}
+	}
+
+	//! Paths as a JSON array, Windows paths are full of backslashes.
+	std::string JsonPaths(const std::vector<std::string>& paths)
+	{
+		std::string sJson = "[";
+
+		for (auto& path : paths)
+		{
+			if (sJson.size() > 1)
+				sJson += ',';
+
+			sJson += '"';
+
+			for (char c : path)
+			{
+				if (c == '"' || c == '\\')
+					sJson += '\\';
+
+				sJson += c;
+			}
+
+			sJson += '"';
+		}
+
+		return sJson + "]";
+	}
+}
+
+VifDaemon::VifDaemon(std::string_view pipe_name, std::size_t job_threads, const VifOptions_t& defaults)
+	: m_pipeName("\\\\.\\pipe\\" + std::string(pipe_name))
+	, m_jobThreads(job_threads ? job_threads : DEFAULT_JOB_THREADS)
+	, m_defaults(defaults)
+{
+}
+
+bool VifDaemon::Run()
+{
+	for (std::size_t i = 0; i < m_jobThreads; ++i)
+		m_threads.emplace_back(&VifDaemon::_work, this);
+
+	logger->info("Serving on {} with {} job threads", m_pipeName, m_jobThreads);
+
+	for (std::size_t nClient = 1;; ++nClient)
+	{
+		//
+		// One pipe instance per client, the next one is only created once this one is connected.
+		auto client = std::make_shared<Client_t>();
+
+		client->id = nClient;
+		client->pipe = CreateNamedPipeA(m_pipeName.c_str(),
+			PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+			PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+			PIPE_UNLIMITED_INSTANCES,
+			PIPE_BUFFER_SIZE,
+			PIPE_BUFFER_SIZE,
+			0,
+			nullptr);
+
+		if (client->pipe == INVALID_HANDLE_VALUE)
+		{
+			logger->critical("Unable to create pipe {} (error: {})", m_pipeName, GetLastError());
+			break;
+		}
+
+		if (!ConnectPipe(client->pipe))
+		{
+			logger->error("Unable to connect a client (error: {})", GetLastError());
+			continue;
+		}
+
+		logger->info("Client {} connected", client->id);
+
+		//
+		// Clients come and go, their threads end with the connection.
+		std::thread(&VifDaemon::_serve, this, std::move(client)).detach();
+	}
+
+	{
+		std::lock_guard lock(m_lock);
+		m_stop = true;
+	}
+
+	m_wake.notify_all();
+
+	for (auto& thread : m_threads)
+		thread.join();
+
+	return false;
+}
+
+void VifDaemon::_serve(std::shared_ptr<Client_t> client)
+{
+	std::string sBuffer;
+	char buffer[4096];
+	DWORD dwRead = 0;
+
+	while (PipeIo(client->pipe, dwRead, [&](OVERLAPPED* ov) { return ReadFile(client->pipe, buffer, sizeof(buffer), nullptr, ov); }) && dwRead > 0)
+	{
+		sBuffer.append(buffer, dwRead);
+
+		for (std::size_t nEnd; (nEnd = sBuffer.find('\n')) != std::string::npos; sBuffer.erase(0, nEnd + 1))
+		{
+			std::string_view line(sBuffer.data(), nEnd);
+
+			if (!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+
+			if (line.empty())
+				continue;
+
+			Job_t job;
+			std::string sError;
+
+			job.id = m_nextJob++;
+			job.options = m_defaults;
+
+			if (!_parse(line, job, sError))
+			{
+				_reply(*client, fmt::format(R"({{"job":{},"status":"error","error":"{}"}})", job.id, sError));
+				continue;
+			}
+
+			logger->info("Client {} queued job {}: {}", client->id, job.id, line);
+			_reply(*client, fmt::format(R"({{"job":{},"status":"queued"}})", job.id));
+
+			std::lock_guard lock(m_lock);
+
+			if (client->jobs.empty())
+				m_ready.push_back(client);
+
+			client->jobs.push_back(std::move(job));
+			m_wake.notify_one();
+		}
+	}
+
+	//
+	// Jobs already queued still run, their replies go nowhere.
+	logger->info("Client {} disconnected", client->id);
+}
+
+void VifDaemon::_work()
+{
+	for (;;)
+	{
+		std::shared_ptr<Client_t> client;
+		Job_t job;
+
+		{
+			std::unique_lock lock(m_lock);
+			m_wake.wait(lock, [this] { return m_stop || !m_ready.empty(); });
+
+			if (m_stop)
+				return;
+
+			client = std::move(m_ready.front());
+			m_ready.pop_front();
+
+			job = std::move(client->jobs.front());
+			client->jobs.pop_front();
+
+			if (!client->jobs.empty())
+				m_ready.push_back(client);
+		}
+
+		_reply(*client, _run(job));
+	}
+}
+
+bool VifDaemon::_parse(std::string_view line, Job_t& job, std::string& error) const
+{
+	//
+	// Split like a command line, double quotes keep paths with spaces together.
+	std::vector<std::string> vecArgs;
+
+	for (std::size_t i = 0; i < line.size();)
+	{
+		if (line[i] == ' ' || line[i] == '\t')
+		{
+			++i;
+			continue;
+		}
+
+		std::size_t nEnd = line[i] == '"' ? line.find('"', i + 1) : line.find_first_of(" \t", i);
+
+		if (line[i] == '"')
+		{
+			if (nEnd == std::string_view::npos)
+			{
+				error = "unterminated quote";
+				return false;
+			}
+
+			vecArgs.emplace_back(line.substr(i + 1, nEnd - i - 1));
+			i = nEnd + 1;
+		}
+		else
+		{
+			nEnd = std::min(nEnd, line.size());
+			vecArgs.emplace_back(line.substr(i, nEnd - i));
+			i = nEnd;
+		}
+	}
+
+	//
+	// Sections given with the job replace the default ones, rather than adding to them.
+	bool bSections = false;
+	bool bOutput = false;
+
+	for (std::size_t i = 0; i < vecArgs.size(); ++i)
+	{
+		const char* szArg = vecArgs[i].c_str();
+		bool bValue = (i + 1) < vecArgs.size();
+
+		if (_stricmp(szArg, "-f") == 0 && bValue)
+		{
+			job.snapshot_path = vecArgs[++i];
+		}
+		else if (_stricmp(szArg, "-p") == 0 && bValue)
+		{
+			job.process_id = std::strtoul(vecArgs[++i].c_str(), nullptr, 10);
+
+			if (job.process_id == 0)
+			{
+				error = "invalid process id";
+				return false;
+			}
+		}
+		else if (_stricmp(szArg, "-mod") == 0 && bValue)
+		{
+			job.module = vecArgs[++i];
+		}
+		else if (_stricmp(szArg, "-section") == 0 && bValue)
+		{
+			if (!bSections)
+				job.options.section_names.clear();
+
+			job.options.section_names.push_back(vecArgs[++i]);
+			bSections = true;
+		}
+		else if (_stricmp(szArg, "-all") == 0)
+		{
+			job.options.fix_all = true;
+		}
+		else if (_stricmp(szArg, "-cache") == 0 && bValue)
+		{
+			job.options.cache_path = vecArgs[++i];
+		}
+		else if (_stricmp(szArg, "-budget") == 0 && bValue)
+		{
+			job.options.instruction_budget = std::strtoull(vecArgs[++i].c_str(), nullptr, 10);
+		}
+		else if (_stricmp(szArg, "-timeout") == 0 && bValue)
+		{
+			job.options.time_budget_ms = std::strtoull(vecArgs[++i].c_str(), nullptr, 10);
+		}
+		else if (_stricmp(szArg, "-nofast") == 0)
+		{
+			job.options.fast_path = false;
+		}
+		else if (_stricmp(szArg, "-verify") == 0)
+		{
+			job.options.verify_fast_path = true;
+		}
+		else if (_stricmp(szArg, "-sitelog") == 0 && bValue)
+		{
+			job.options.site_log_path = vecArgs[++i];
+		}
+		else if (_stricmp(szArg, "-metrics") == 0 && bValue)
+		{
+			job.options.metrics_path = vecArgs[++i];
+		}
+		else if (_stricmp(szArg, "-o") == 0 && bValue)
+		{
+			job.options.output_dir = vecArgs[++i];
+			bOutput = true;
+		}
+		else
+		{
+			//
+			// The argument isn't echoed back, it could hold anything.
+			error = fmt::format("unknown or incomplete argument {}", i + 1);
+			return false;
+		}
+	}
+
+	if (job.snapshot_path.empty() == (job.process_id == 0))
+	{
+		error = "a job needs either -f or -p";
+		return false;
+	}
+
+	if (!job.snapshot_path.empty() && !vif::Snapshot::IsSnapshotFile(job.snapshot_path))
+	{
+		error = "not a snapshot file";
+		return false;
+	}
+
+	//
+	// Jobs run side by side, two of them fixing the same module must not write to the same file. Without a
+	// directory of its own, a job's files carry its id.
+	if (!bOutput)
+		job.options.output_suffix = fmt::format(".job{}", job.id);
+
+	return true;
+}
+
+std::string VifDaemon::_run(const Job_t& job)
+{
+	spdlog::stopwatch sw;
+	std::string sMetrics;
+	std::string sOutputs;
+	bool bFixed = false;
+	bool bWarm = false;
+	std::error_code ec;
+
+	std::filesystem::create_directories(job.options.output_dir, ec);
+
+	if (ec)
+		return fmt::format(R"({{"job":{},"status":"error","error":"unable to create the output directory"}})", job.id);
+
+	if (!job.snapshot_path.empty())
+	{
+		std::string sError;
+		std::shared_ptr<Warm_t> warm = _warm(job.snapshot_path, bWarm, sError);
+
+		if (!warm)
+			return fmt::format(R"({{"job":{},"status":"error","error":"{}"}})", job.id, sError);
+
+		VifOptions_t options = job.options;
+		options.keep_warm = true;
+
+		//
+		// Jobs on the same snapshot wait for each other here, jobs on other snapshots carry on.
+		std::lock_guard lock(warm->lock);
+
+		warm->fixer->SetOptions(options);
+		bFixed = warm->fixer->DumpFromSnapshot(warm->snapshot, job.module);
+		sMetrics = warm->fixer->GetMetrics().ToJson(true);
+		sOutputs = JsonPaths(warm->fixer->GetOutputPaths());
+	}
+	else
+	{
+		//
+		// A live process may have changed since the last job, nothing is kept for those.
+		HANDLE hProcess = OpenProcess(PROCESS_ALL_ACCESS, FALSE, job.process_id);
+		BOOL bIsWow64 = FALSE;
+
+		if (hProcess == nullptr)
+			return fmt::format(R"({{"job":{},"status":"error","error":"unable to open process {}"}})", job.id, job.process_id);
+
+		IsWow64Process(hProcess, &bIsWow64);
+
+		std::unique_ptr<IVMPImportFixer> pImportFixer(bIsWow64 ?
+			VifFactory_GenerateFixer<32>(job.options) :
+			VifFactory_GenerateFixer<64>(job.options));
+
+		//
+		// The fixer takes over the handle.
+		bFixed = pImportFixer->DumpInMemory(hProcess, job.module);
+		sMetrics = pImportFixer->GetMetrics().ToJson(true);
+		sOutputs = JsonPaths(pImportFixer->GetOutputPaths());
+	}
+
+	double dSeconds = std::chrono::duration<double>(sw.elapsed()).count();
+
+	logger->info("Job {} {} in {:.3f}s", job.id, bFixed ? "done" : "failed", dSeconds);
+
+	return fmt::format(R"({{"job":{},"status":"{}","warm":{},"seconds":{:.6f},"outputs":{},"metrics":{}}})",
+		job.id, bFixed ? "done" : "failed", bWarm, dSeconds, sOutputs, sMetrics);
+}
+
+std::shared_ptr<VifDaemon::Warm_t> VifDaemon::_warm(const std::string& path, bool& reused, std::string& error)
+{
+	std::error_code ec;
+	std::filesystem::path key = std::filesystem::weakly_canonical(path, ec);
+
+	if (ec)
+		key = path;
+
+	std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(key, ec);
+	std::lock_guard lock(m_warmLock);
+
+	reused = false;
+
+	if (auto it = m_warm.find(key.string()); it != m_warm.end() && it->second->write_time == writeTime)
+	{
+		it->second->last_used = ++m_uses;
+		reused = true;
+		return it->second;
+	}
+
+	//
+	// New, or written since. A job still running on the old one keeps it alive until it is done.
+	auto warm = std::make_shared<Warm_t>();
+
+	if (!warm->snapshot.Open(key.string()))
+	{
+		error = "unable to map snapshot";
+		return nullptr;
+	}
+
+	VifOptions_t options = m_defaults;
+	options.keep_warm = true;
+
+	if (warm->snapshot.GetBitSize() == 32)
+		warm->fixer.reset(VifFactory_GenerateFixer<32>(options));
+	else
+		warm->fixer.reset(VifFactory_GenerateFixer<64>(options));
+
+	warm->write_time = writeTime;
+	warm->last_used = ++m_uses;
+	m_warm[key.string()] = warm;
+
+	if (m_warm.size() > MAX_WARM_SNAPSHOTS)
+	{
+		auto oldest = std::min_element(m_warm.begin(), m_warm.end(), [](const auto& a, const auto& b) { return a.second->last_used < b.second->last_used; });
+
+		logger->info("Dropping warm snapshot {}", oldest->first);
+		m_warm.erase(oldest);
+	}
+
+	logger->info("Warming up {}", key.string());
+	return warm;
+}
+
+void VifDaemon::_reply(Client_t& client, std::string_view line)
+{
+	std::lock_guard lock(client.write_lock);
+	std::string sLine = std::string(line) + "\n";
+
+	for (std::size_t nOffset = 0; nOffset < sLine.size();)
+	{
+		DWORD dwWritten = 0;
+
+		if (!PipeIo(client.pipe, dwWritten, [&](OVERLAPPED* ov)
+			{
+				return WriteFile(client.pipe, sLine.data() + nOffset, static_cast<DWORD>(sLine.size() - nOffset), nullptr, ov);
+			}) || dwWritten == 0)
+			return;
+
+		nOffset += dwWritten;
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+///
+//! class VifDaemon
+//! Serves fix jobs over a named pipe, one line per job holding the same arguments as the command line.
+//! Snapshots stay warm between jobs: the mapping, the module views with every export directory read so far,
+//! the loaded target images and the engine pool. Jobs of every client run on one set of job threads.
+///
+class VifDaemon : pepp::msc::NonCopyable
+{
+public:
+	//! Jobs run at once, unless asked for otherwise. Every job already spreads its emulation over the engines.
+	static constexpr std::size_t DEFAULT_JOB_THREADS = 2;
+
+	//! Snapshots kept warm at most, the one used longest ago is dropped first.
+	static constexpr std::size_t MAX_WARM_SNAPSHOTS = 8;
+
+	//! Serve on \\.\pipe\<pipe_name>. `defaults` are what every job starts out with.
+	VifDaemon(std::string_view pipe_name, std::size_t job_threads, const VifOptions_t& defaults);
+
+	//! Serve until the process is ended.
+	//! - returns false if the pipe can't be created.
+	bool Run();
+
+private:
+	//! A job as read off of the pipe
+	struct Job_t
+	{
+		std::uint64_t	id = 0;
+		std::string		snapshot_path{};
+		DWORD			process_id = 0;
+		std::string		module{};
+		VifOptions_t	options{};
+	};
+
+	//! A connected client, every reply is a single line.
+	struct Client_t
+	{
+		vif::nt::ScopedHandle	pipe;
+		std::size_t				id = 0;
+		std::mutex				write_lock;
+		//! Only touched under m_lock
+		std::deque<Job_t>		jobs;
+	};
+
+	//! A snapshot and the fixer kept for it. The fixer points into the mapping, so it is declared (and destroyed) after it.
+	struct Warm_t
+	{
+		//! A fixer runs one job at a time
+		std::mutex							lock;
+		std::filesystem::file_time_type		write_time{};
+		vif::Snapshot						snapshot;
+		std::unique_ptr<IVMPImportFixer>	fixer;
+		std::uint64_t						last_used = 0;
+	};
+
+	//! Read jobs off of a client's pipe and queue them, until it disconnects.
+	void _serve(std::shared_ptr<Client_t> client);
+
+	//! Take jobs off of the queue and run them, until the daemon stops.
+	void _work();
+
+	//! Parse a job line
+	//! - returns false with `error` set if it isn't a valid job.
+	bool _parse(std::string_view line, Job_t& job, std::string& error) const;
+
+	//! Run a job, returns the reply.
+	std::string _run(const Job_t& job);
+
+	//! The warm fixer of a snapshot, made (or remade, if the file changed) if needed.
+	std::shared_ptr<Warm_t> _warm(const std::string& path, bool& reused, std::string& error);
+
+	//! Write a line to a client, a client that has gone away is ignored.
+	void _reply(Client_t& client, std::string_view line);
+
+	std::string								m_pipeName;
+	std::size_t								m_jobThreads;
+	VifOptions_t							m_defaults;
+	std::vector<std::thread>				m_threads;
+	std::atomic<std::uint64_t>				m_nextJob{ 1 };
+	std::mutex								m_lock;
+	std::condition_variable					m_wake;
+	//! Clients with queued jobs. A client goes to the back once one of its jobs is taken, so a client queuing
+	//! many jobs can't hold up one that queued a single job.
+	std::deque<std::shared_ptr<Client_t>>	m_ready;
+	bool									m_stop = false;
+	std::mutex								m_warmLock;
+	std::map<std::string, std::shared_ptr<Warm_t>> m_warm;
+	std::uint64_t							m_uses = 0;
+};
@@ -0,0 +1,815 @@
+#include "VMPImportFixer.hpp"
+
+// Explicit templates.
+template class VifEmulator<32>;
+template class VifEmulator<64>;
+template class VifEmulatorPool<32>;
+template class VifEmulatorPool<64>;
+
+template<size_t BitSize>
+VifEmulator<BitSize>::VifEmulator(IVMPImportFixer* fixer) noexcept
+	: m_fixer(fixer)
+{
+}
+
+template<size_t BitSize>
+VifEmulator<BitSize>::~VifEmulator()
+{
+	if (m_context)
+		uc_context_free(m_context);
+
+	if (m_uc)
+		uc_close(m_uc);
+}
+
+template<size_t BitSize>
+bool VifEmulator<BitSize>::Initialize(const std::vector<VifMemoryRegion_t>& regions, const VifLazyMemoryMap* lazy, std::uint64_t stack_base, std::uint64_t stack_size) noexcept
+{
+	static constexpr uc_mode EMULATION_MODE = BitSize == 32 ? UC_MODE_32 : UC_MODE_64;
+	static constexpr uc_x86_reg STACK_REGISTER = BitSize == 32 ? UC_X86_REG_ESP : UC_X86_REG_RSP;
+
+	uc_err err = uc_open(UC_ARCH_X86, EMULATION_MODE, &m_uc);
+
+	if (err != UC_ERR_OK)
+	{
+		m_uc = nullptr;
+		logger->critical("Unable to open Unicorn in X86-{} mode (err: {})", BitSize, err);
+		return false;
+	}
+
+	//
+	// The stack is just another region, backed by zeroes. It is the engine's own, so it is writable from the
+	// start, and nothing on it is ever executed.
+	m_stackSource.assign(stack_size, 0);
+	m_regions = regions;
+	m_regions.push_back({ stack_base, stack_size, m_stackSource.data(), UC_PROT_READ | UC_PROT_WRITE });
+	m_lazy = lazy;
+
+	//
+	// Map the shared buffers directly, read only. A stub that does write to one gets a copy of the page.
+	for (auto& region : m_regions)
+	{
+		err = uc_mem_map_ptr(m_uc, region.address, region.size, region.perms, const_cast<std::uint8_t*>(region.data));
+		if (err != UC_ERR_OK)
+		{
+			logger->critical("Could not map in region {:X} => uc_mem_map_ptr() failed with error: {}", region.address, err);
+			return false;
+		}
+	}
+
+	m_stack = static_cast<AddressType>((stack_base + stack_size - pepp::PAGE_SIZE) & -0x10);
+	m_stackBase = stack_base;
+	m_stackLow = stack_base + stack_size;
+	m_dirtyPages.reserve(16);
+
+	//
+	// Save the clean register state, it is restored before every stub.
+	uc_reg_write(m_uc, STACK_REGISTER, &m_stack);
+
+	if ((err = uc_context_alloc(m_uc, &m_context)) != UC_ERR_OK ||
+		(err = uc_context_save(m_uc, m_context)) != UC_ERR_OK)
+	{
+		logger->critical("Could not save the initial context: {}", err);
+		return false;
+	}
+
+	//
+	// Rather than inspecting every instruction for the final RET, let the RET execute. Code of other modules
+	// is never mapped executable, so the stub exiting shows up as a single failed fetch: unmapped, or a
+	// protection fault if a read already brought the page in.
+	if ((err = uc_hook_add(m_uc,
+		&m_unmappedHook,
+		UC_HOOK_MEM_UNMAPPED,
+		MemUnmappedHook,
+		this,
+		1,
+		0)) != UC_ERR_OK)
+	{
+		logger->critical("Could not install an unmapped memory hook: {}", err);
+		return false;
+	}
+
+	if ((err = uc_hook_add(m_uc,
+		&m_fetchProtHook,
+		UC_HOOK_MEM_FETCH_PROT,
+		FetchProtHook,
+		this,
+		1,
+		0)) != UC_ERR_OK)
+	{
+		logger->critical("Could not install a fetch hook: {}", err);
+		return false;
+	}
+
+	//
+	// Writes are only recorded, so the next stub gets a clean slate without restoring every page. One hook over the
+	// stack, one over the span of the writable pages (pages in between are
+	// read only, a stub writing to one gets a copy, see PromotePage).
+	m_writableBegin = ~0ull;
+	m_writableEnd = 0;
+
+	if (m_lazy)
+	{
+		for (auto& range : *m_lazy)
+		{
+			for (auto& writable : range.value.writable)
+			{
+				m_writableBegin = std::min(m_writableBegin, range.value.address + writable.begin);
+				m_writableEnd = std::max(m_writableEnd, range.value.address + writable.end);
+			}
+		}
+	}
+
+	if ((err = uc_hook_add(m_uc,
+		&m_stackWriteHook,
+		UC_HOOK_MEM_WRITE,
+		WriteHook,
+		this,
+		stack_base,
+		stack_base + stack_size - 1)) != UC_ERR_OK ||
+		(m_writableBegin < m_writableEnd && (err = uc_hook_add(m_uc,
+		&m_privateWriteHook,
+		UC_HOOK_MEM_WRITE,
+		WriteHook,
+		this,
+		m_writableBegin,
+		m_writableEnd - 1)) != UC_ERR_OK))
+	{
+		logger->critical("Could not install a write hook: {}", err);
+		return false;
+	}
+
+	if ((err = uc_hook_add(m_uc,
+		&m_writeProtHook,
+		UC_HOOK_MEM_WRITE_PROT,
+		WriteProtHook,
+		this,
+		1,
+		0)) != UC_ERR_OK)
+	{
+		logger->critical("Could not install a write protection hook: {}", err);
+		return false;
+	}
+
+	//
+	// When several images are executable a stub can jump straight into another one's code without a fault,
+	// so every block has to be checked against the stub's own image.
+	if (m_lazy)
+		m_checkImage = std::count_if(m_lazy->begin(), m_lazy->end(), [](const auto& range) { return (range.value.perms & UC_PROT_EXEC) != 0; }) > 1;
+
+	if (!ZYAN_SUCCESS(ZydisDecoderInit(&m_decoder,
+		BitSize == 32 ? ZYDIS_MACHINE_MODE_LONG_COMPAT_32 : ZYDIS_MACHINE_MODE_LONG_64,
+		BitSize == 32 ? ZYDIS_ADDRESS_WIDTH_32 : ZYDIS_ADDRESS_WIDTH_64)))
+	{
+		logger->critical("Unable to initialize Zydis for the emulator");
+		return false;
+	}
+
+	//
+	// The micro emulator reads the same regions, and starts from the same stack pointer.
+	m_micro = std::make_unique<VifMicroEmulator<BitSize>>(&m_decoder);
+	m_micro->Initialize(&m_regions, m_lazy, stack_base, stack_size, m_stack);
+
+	//
+	// Blocks rather than instructions are hooked, each block is only decoded the first time it is seen.
+	if ((err = uc_hook_add(m_uc,
+		&m_blockHook,
+		UC_HOOK_BLOCK,
+		BlockHook,
+		this,
+		1,
+		0)) != UC_ERR_OK)
+	{
+		logger->critical("Could not install a block hook: {}", err);
+		return false;
+	}
+
+	return true;
+}
+
+template<size_t BitSize>
+bool VifEmulator<BitSize>::Resolve(const VifStubJob_t& job, const VifBudget_t& budget, VifResolvedImport_t& result) noexcept
+{
+	AddressType rtnaddress = static_cast<AddressType>(job.return_address);
+
+	result = {};
+	m_job = &job;
+	m_exitAddress = 0;
+	m_exited = false;
+	m_budget = budget;
+	m_budgetExceeded = false;
+	m_stubInstructions = 0;
+	m_stubMicroseconds = 0;
+	m_stubBlocks = 0;
+
+	//
+	// Most stubs are a few moves and some arithmetic, no need to bring Unicorn up for those.
+	std::uint64_t uFastExit = 0;
+	bool bFast = false;
+
+	if (m_fastPath)
+	{
+		spdlog::stopwatch swFast;
+		std::uint64_t uLimit = budget.instructions ? std::min(budget.instructions, VifMicroEmulator<BitSize>::MAX_INSTRUCTIONS) : VifMicroEmulator<BitSize>::MAX_INSTRUCTIONS;
+
+		bFast = m_micro->Run(job, uLimit, uFastExit);
+
+		if (bFast)
+			++m_fastStubs;
+		else
+			++m_fastFallbacks;
+
+		if (bFast && !m_verify)
+		{
+			m_stubInstructions = m_micro->GetLastInstructions();
+			m_stubMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(swFast.elapsed()).count();
+			m_instructionHistogram.Add(m_stubInstructions);
+			m_timeHistogram.Add(m_stubMicroseconds);
+
+			return ResolveExit(uFastExit, result);
+		}
+	}
+
+	spdlog::stopwatch sw;
+	m_deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget.microseconds);
+
+	uc_err uerr = UC_ERR_OK;
+
+	for (std::size_t nPromotions = 0;; ++nPromotions)
+	{
+		//
+		// Undo everything the previous stub (or the previous try of this one) did, so results don't depend on
+		// the order stubs run in.
+		ResetPrivatePages();
+		uc_context_restore(m_uc, m_context);
+
+		//
+		// Write the return address as if we just entered a CALL.
+		uc_mem_write(m_uc, m_stack, &rtnaddress, sizeof(rtnaddress));
+
+		//
+		// Begin emulation. The budget is enforced by the block hook, uc_emu_start's own count and timeout
+		// would add a hook on every instruction and a timer thread per stub.
+		uerr = uc_emu_start(m_uc, job.stub, 0, 0, 0);
+
+		if (uerr != UC_ERR_WRITE_PROT || m_promotePages.empty() || m_budgetExceeded || nPromotions == MAX_PROMOTIONS)
+			break;
+
+		//
+		// The stub wrote to a page mapped read only (its own code, a read only .vmp section). Give it a copy of
+		// the page and start over, the copy stays for every stub after.
+		bool bPromoted = std::all_of(m_promotePages.begin(), m_promotePages.end(), [this](std::uint64_t page) { return PromotePage(page); });
+
+		m_promotePages.clear();
+		m_exited = false;
+
+		if (!bPromoted)
+			break;
+	}
+
+	m_promotePages.clear();
+
+	m_stubMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(sw.elapsed()).count();
+	m_instructionHistogram.Add(m_stubInstructions);
+	m_timeHistogram.Add(m_stubMicroseconds);
+
+	//
+	// Both engines ran, Unicorn's result is the one used.
+	if (bFast && (!m_exited || m_exitAddress != static_cast<AddressType>(uFastExit)))
+	{
+		++m_fastMismatches;
+		logger->error("Stub {:X}: micro emulator exits to {:X}, Unicorn to {:X}", job.stub, uFastExit, m_exited ? m_exitAddress : 0);
+	}
+
+	if (m_budgetExceeded)
+	{
+		logger->warn("Stub {:X} went over its budget after {} instructions ({} us)", job.stub, m_stubInstructions, m_stubMicroseconds);
+		result.failure = VifFailure::BudgetExceeded;
+		return false;
+	}
+
+	//
+	// The fetch hooks stop emulation by failing the fetch, that is the expected way out. The block hook stops it cleanly.
+	if (uerr != UC_ERR_OK && !((uerr == UC_ERR_FETCH_UNMAPPED || uerr == UC_ERR_FETCH_PROT) && m_exited))
+	{
+		switch (uerr)
+		{
+		case UC_ERR_READ_UNMAPPED:
+		case UC_ERR_WRITE_UNMAPPED:
+		case UC_ERR_FETCH_UNMAPPED:
+		case UC_ERR_READ_PROT:
+		case UC_ERR_WRITE_PROT:
+			result.failure = VifFailure::UnmappedAccess;
+			break;
+		default:
+			result.failure = VifFailure::NoReturn;
+			break;
+		}
+
+		logger->error("Emulation of stub {:X} failed with error: {}", job.stub, uerr);
+		return false;
+	}
+
+	if (!m_exited)
+	{
+		result.failure = VifFailure::NoReturn;
+		return false;
+	}
+
+	return ResolveExit(m_exitAddress, result);
+}
+
+template<size_t BitSize>
+bool VifEmulator<BitSize>::ResolveExit(std::uint64_t exit_address, VifResolvedImport_t& result) noexcept
+{
+	//
+	// Real import address is where the stub returned to.
+	if (const VIFModuleInformation_t* mod = m_fixer->GetModuleFromAddress(exit_address))
+	{
+		//
+		// Imports are only added by name, so an export without one is as good as not found.
+		if (!m_fixer->GetExportData(mod->base_address, exit_address - mod->base_address, &result.exp) ||
+			result.exp.name.empty())
+		{
+			logger->critical("Could not find export from address {:X}", exit_address);
+			result.failure = VifFailure::NoExport;
+			return false;
+		}
+
+		result.module_name = mod->module_name;
+		result.resolved = true;
+	}
+	else
+	{
+		logger->critical("Could not find module from address {:X}", exit_address);
+		result.failure = VifFailure::OutsideModules;
+	}
+
+	return result.resolved;
+}
+
+template<size_t BitSize>
+bool VifEmulator<BitSize>::MemUnmappedHook(uc_engine* uc, uc_mem_type type, uint64_t address, int size, int64_t value, void* user_data)
+{
+	VifEmulator* pEmu = static_cast<VifEmulator*>(user_data);
+	std::uint64_t first = address & ~(std::uint64_t)(pepp::PAGE_SIZE - 1);
+	std::uint64_t last = (address + std::max(size, 1) - 1) & ~(std::uint64_t)(pepp::PAGE_SIZE - 1);
+
+	if (type == UC_MEM_FETCH_UNMAPPED)
+	{
+		//
+		// Stubs jump around inside the image, only fetches from elsewhere are the way out.
+		const VifMemoryRegion_t* region = pEmu->m_lazy ? pEmu->m_lazy->FindValue(first) : nullptr;
+		if (region != nullptr && (region->perms & UC_PROT_EXEC) && pEmu->MapLazyPage(first) != nullptr)
+			return true;
+
+		pEmu->m_exitAddress = static_cast<AddressType>(address);
+		pEmu->m_exited = true;
+
+		//
+		// Fail the fetch, which ends emulation.
+		return false;
+	}
+
+	//
+	// An access can straddle two pages, only one of which may be missing.
+	for (std::uint64_t page = first; page <= last; page += pepp::PAGE_SIZE)
+	{
+		//
+		// The other half of the access may lie in a region mapped up front.
+		if (std::any_of(pEmu->m_regions.begin(), pEmu->m_regions.end(), [page](const VifMemoryRegion_t& region)
+			{
+				return page >= region.address && page < region.address + region.size;
+			}))
+			continue;
+
+		//
+		// Writable pages come in as private copies, a write to any other page fails once it is mapped.
+		if (pEmu->MapLazyPage(page) == nullptr)
+			return false;
+	}
+
+	return true;
+}
+
+template<size_t BitSize>
+bool VifEmulator<BitSize>::FetchProtHook(uc_engine* uc, uc_mem_type type, uint64_t address, int size, int64_t value, void* user_data)
+{
+	VifEmulator* pEmu = static_cast<VifEmulator*>(user_data);
+
+	pEmu->m_exitAddress = static_cast<AddressType>(address);
+	pEmu->m_exited = true;
+
+	return false;
+}
+
+template<size_t BitSize>
+void VifEmulator<BitSize>::WriteHook(uc_engine* uc, uc_mem_type type, uint64_t address, int size, int64_t value, void* user_data)
+{
+	VifEmulator* pEmu = static_cast<VifEmulator*>(user_data);
+
+	if (address >= pEmu->m_stackBase && address < pEmu->m_stackBase + pEmu->m_stackSource.size())
+	{
+		pEmu->m_stackLow = std::min<std::uint64_t>(pEmu->m_stackLow, address);
+		return;
+	}
+
+	std::uint64_t first = address & ~(std::uint64_t)(pepp::PAGE_SIZE - 1);
+	std::uint64_t last = (address + std::max(size, 1) - 1) & ~(std::uint64_t)(pepp::PAGE_SIZE - 1);
+
+	for (std::uint64_t page = first; page <= last; page += pepp::PAGE_SIZE)
+	{
+		if (std::find(pEmu->m_dirtyPages.begin(), pEmu->m_dirtyPages.end(), page) == pEmu->m_dirtyPages.end())
+			pEmu->m_dirtyPages.push_back(page);
+	}
+}
+
+template<size_t BitSize>
+bool VifEmulator<BitSize>::WriteProtHook(uc_engine* uc, uc_mem_type type, uint64_t address, int size, int64_t value, void* user_data)
+{
+	VifEmulator* pEmu = static_cast<VifEmulator*>(user_data);
+	std::uint64_t first = address & ~(std::uint64_t)(pepp::PAGE_SIZE - 1);
+	std::uint64_t last = (address + std::max(size, 1) - 1) & ~(std::uint64_t)(pepp::PAGE_SIZE - 1);
+
+	for (std::uint64_t page = first; page <= last; page += pepp::PAGE_SIZE)
+	{
+		if (pEmu->m_privatePages.count(page) == 0 &&
+			std::find(pEmu->m_promotePages.begin(), pEmu->m_promotePages.end(), page) == pEmu->m_promotePages.end())
+			pEmu->m_promotePages.push_back(page);
+	}
+
+	//
+	// Fail the write, the page is swapped once emulation has stopped.
+	return false;
+}
+
+template<size_t BitSize>
+void VifEmulator<BitSize>::BlockHook(uc_engine* uc, uint64_t address, uint32_t size, void* user_data)
+{
+	VifEmulator* pEmu = static_cast<VifEmulator*>(user_data);
+
+	if (pEmu->m_checkImage && (address < pEmu->m_job->image_begin || address >= pEmu->m_job->image_end))
+	{
+		pEmu->m_exitAddress = static_cast<AddressType>(address);
+		pEmu->m_exited = true;
+
+		uc_emu_stop(uc);
+		return;
+	}
+
+	pEmu->m_stubInstructions += pEmu->CountInstructions(address, size);
+
+	//
+	// The clock is only read every 64 blocks, a block takes well under a microsecond.
+	if ((pEmu->m_budget.instructions && pEmu->m_stubInstructions > pEmu->m_budget.instructions) ||
+		(pEmu->m_budget.microseconds && (++pEmu->m_stubBlocks & 0x3f) == 0 && std::chrono::steady_clock::now() > pEmu->m_deadline))
+	{
+		pEmu->m_budgetExceeded = true;
+		uc_emu_stop(uc);
+	}
+}
+
+template<size_t BitSize>
+std::uint32_t VifEmulator<BitSize>::CountInstructions(std::uint64_t address, std::uint32_t size) noexcept
+{
+	auto [it, bInserted] = m_blockInstructions.try_emplace(address, size, 0);
+
+	if (!bInserted && it->second.first == size)
+		return it->second.second;
+
+	//
+	// Counted from guest memory, so code written by the stub is counted as it runs.
+	std::uint32_t nCount = 0;
+	ZydisDecodedInstruction insn;
+
+	m_blockBuffer.resize(size);
+
+	if (uc_mem_read(m_uc, address, m_blockBuffer.data(), size) == UC_ERR_OK)
+	{
+		for (std::uint32_t offset = 0; offset < size && ZYAN_SUCCESS(ZydisDecoderDecodeBuffer(&m_decoder, m_blockBuffer.data() + offset, size - offset, &insn)); offset += insn.length)
+			++nCount;
+	}
+
+	it->second = { size, nCount };
+	return nCount;
+}
+
+template<size_t BitSize>
+const VifMemoryRegion_t* VifEmulator<BitSize>::MapLazyPage(std::uint64_t page) noexcept
+{
+	const VifMemoryRegion_t* region = m_lazy ? m_lazy->FindValue(page) : nullptr;
+
+	if (region == nullptr || !m_lazyPages.insert(page).second)
+		return region;
+
+	const std::uint8_t* pSource = region->GetPage(page);
+	if (pSource == nullptr)
+	{
+		m_lazyPages.erase(page);
+		return nullptr;
+	}
+
+	//
+	// Pages stubs may write to are private from the start. The shared page is never mapped where a write could
+	// reach it, and no mapping has to be swapped out from under a running stub later on.
+	const std::uint8_t* pMapped = pSource;
+	std::uint32_t uPerms = region->perms;
+	OverlayPage_t overlay{};
+
+	if (region->IsWritable(page))
+	{
+		overlay = { std::make_unique<std::uint8_t[]>(pepp::PAGE_SIZE), pSource, region->perms | UC_PROT_WRITE };
+		std::memcpy(overlay.data.get(), pSource, pepp::PAGE_SIZE);
+
+		pMapped = overlay.data.get();
+		uPerms = overlay.perms;
+	}
+
+	uc_err err = uc_mem_map_ptr(m_uc, page, pepp::PAGE_SIZE, uPerms, const_cast<std::uint8_t*>(pMapped));
+	if (err != UC_ERR_OK)
+	{
+		logger->error("Could not map in page {:X} on demand => uc_mem_map_ptr() failed with error: {}", page, err);
+		m_lazyPages.erase(page);
+		return nullptr;
+	}
+
+	if (overlay.data)
+		m_privatePages.emplace(page, std::move(overlay));
+
+	++m_pagesFaulted;
+	return region;
+}
+
+template<size_t BitSize>
+bool VifEmulator<BitSize>::PromotePage(std::uint64_t page) noexcept
+{
+	const std::uint8_t* pSource = nullptr;
+	std::uint32_t uPerms = 0;
+
+	auto it = std::find_if(m_regions.begin(), m_regions.end(), [page](const VifMemoryRegion_t& region)
+		{
+			return page >= region.address && page < region.address + region.size;
+		});
+
+	if (it != m_regions.end())
+	{
+		pSource = it->GetPage(page);
+		uPerms = it->perms;
+	}
+	else if (const VifMemoryRegion_t* region = m_lazy && m_lazyPages.count(page) ? m_lazy->FindValue(page) : nullptr)
+	{
+		pSource = region->GetPage(page);
+		uPerms = region->perms;
+	}
+
+	if (pSource == nullptr)
+		return false;
+
+	OverlayPage_t overlay{ std::make_unique<std::uint8_t[]>(pepp::PAGE_SIZE), pSource, uPerms | UC_PROT_WRITE };
+	std::memcpy(overlay.data.get(), pSource, pepp::PAGE_SIZE);
+
+	//
+	// Unmapping a single page out of a region mapped up front splits it, the rest stays on the shared buffer.
+	// Unmapping also throws away any code translated from the page.
+	uc_err err = uc_mem_unmap(m_uc, page, pepp::PAGE_SIZE);
+
+	if (err == UC_ERR_OK && (err = uc_mem_map_ptr(m_uc, page, pepp::PAGE_SIZE, overlay.perms, overlay.data.get())) != UC_ERR_OK)
+		uc_mem_map_ptr(m_uc, page, pepp::PAGE_SIZE, uPerms, const_cast<std::uint8_t*>(pSource));
+
+	if (err != UC_ERR_OK)
+	{
+		logger->error("Could not copy read only page {:X} => {}", page, err);
+		return false;
+	}
+
+	//
+	// Outside the span the private write hook covers, the page needs its own for its writes to be undone.
+	uc_hook hook{};
+
+	if ((page < m_writableBegin || page >= m_writableEnd) &&
+		(err = uc_hook_add(m_uc, &hook, UC_HOOK_MEM_WRITE, WriteHook, this, page, page + pepp::PAGE_SIZE - 1)) != UC_ERR_OK)
+		logger->error("Could not install a write hook on page {:X} => {}", page, err);
+
+	logger->debug("Stub wrote to read only page {:X}, it now has a private copy", page);
+	m_privatePages.emplace(page, std::move(overlay));
+	return true;
+}
+
+template<size_t BitSize>
+void VifEmulator<BitSize>::ResetPrivatePages() noexcept
+{
+	//
+	// The stack is never executed, so it is cleared straight through the buffer Unicorn maps. Only from the
+	// lowest address the last stub wrote, everything below is still zero.
+	std::uint64_t uStackEnd = m_stackBase + m_stackSource.size();
+
+	if (m_stackLow < uStackEnd)
+	{
+		std::memset(m_stackSource.data() + (m_stackLow - m_stackBase), 0, uStackEnd - m_stackLow);
+		m_stackLow = uStackEnd;
+	}
+
+	//
+	// uc_mem_write (rather than a memcpy into the copy) also throws away any code translated from the page.
+	for (std::uint64_t page : m_dirtyPages)
+	{
+		if (auto it = m_privatePages.find(page); it != m_privatePages.end())
+			uc_mem_write(m_uc, page, it->second.source, pepp::PAGE_SIZE);
+	}
+
+	m_dirtyPages.clear();
+}
+
+template<size_t BitSize>
+VifEmulatorPool<BitSize>::VifEmulatorPool(IVMPImportFixer* fixer, std::size_t workers) noexcept
+	: m_fixer(fixer)
+{
+	if (workers == 0)
+		workers = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+	for (std::size_t i = 0; i < workers; ++i)
+		m_engines.emplace_back(std::make_unique<VifEmulator<BitSize>>(fixer));
+}
+
+template<size_t BitSize>
+bool VifEmulatorPool<BitSize>::Initialize(const std::vector<VifMemoryRegion_t>& regions, const VifLazyMemoryMap* lazy, std::uint64_t stack_base, std::uint64_t stack_size) noexcept
+{
+	for (auto& engine : m_engines)
+	{
+		if (!engine->Initialize(regions, lazy, stack_base, stack_size))
+			return false;
+	}
+
+	return true;
+}
+
+template<size_t BitSize>
+std::size_t VifEmulatorPool<BitSize>::GetPagesFaulted() const noexcept
+{
+	std::size_t nPages = 0;
+
+	for (auto& engine : m_engines)
+		nPages += engine->GetPagesFaulted();
+
+	return nPages;
+}
+
+template<size_t BitSize>
+void VifEmulatorPool<BitSize>::SetFastPath(bool enabled, bool verify) noexcept
+{
+	for (auto& engine : m_engines)
+		engine->SetFastPath(enabled, verify);
+}
+
+template<size_t BitSize>
+void VifEmulatorPool<BitSize>::ResetCounters() noexcept
+{
+	for (auto& engine : m_engines)
+		engine->ResetCounters();
+
+	m_retried = 0;
+}
+
+template<size_t BitSize>
+void VifEmulatorPool<BitSize>::GetFastPathStats(VifResolutionStats_t& stats) const noexcept
+{
+	for (auto& engine : m_engines)
+	{
+		stats.fast_path_stubs += engine->GetFastPathStubs();
+		stats.fast_path_fallbacks += engine->GetFastPathFallbacks();
+		stats.fast_path_mismatches += engine->GetFastPathMismatches();
+	}
+}
+
+template<size_t BitSize>
+VifHistogram VifEmulatorPool<BitSize>::GetInstructionHistogram() const noexcept
+{
+	VifHistogram histogram;
+
+	for (auto& engine : m_engines)
+		histogram.Merge(engine->GetInstructionHistogram());
+
+	return histogram;
+}
+
+template<size_t BitSize>
+VifHistogram VifEmulatorPool<BitSize>::GetTimeHistogram() const noexcept
+{
+	VifHistogram histogram;
+
+	for (auto& engine : m_engines)
+		histogram.Merge(engine->GetTimeHistogram());
+
+	return histogram;
+}
+
+template<size_t BitSize>
+VifBudget_t VifEmulatorPool<BitSize>::_budget(const VifBudget_t& budget) const noexcept
+{
+	VifBudget_t adaptive = MAX_BUDGET;
+
+	if (m_resolved.load(std::memory_order_relaxed) >= WARMUP_STUBS)
+	{
+		adaptive.instructions = std::clamp(m_maxInstructions.load(std::memory_order_relaxed) * BUDGET_FACTOR, MIN_BUDGET.instructions, MAX_BUDGET.instructions);
+		adaptive.microseconds = std::clamp(m_maxMicroseconds.load(std::memory_order_relaxed) * BUDGET_FACTOR, MIN_BUDGET.microseconds, MAX_BUDGET.microseconds);
+	}
+
+	return {
+		budget.instructions ? budget.instructions : adaptive.instructions,
+		budget.microseconds ? budget.microseconds : adaptive.microseconds
+	};
+}
+
+template<size_t BitSize>
+void VifEmulatorPool<BitSize>::_run(const std::vector<VifStubJob_t>& jobs, const std::vector<std::size_t>& indices, std::vector<VifResolvedImport_t>& results,
+	std::vector<VifBudget_t>& budgets, const std::function<VifBudget_t(std::size_t)>& budget)
+{
+	std::atomic<std::size_t> nNext{ 0 };
+	std::vector<std::thread> vecWorkers;
+	std::size_t nWorkers = std::min(m_engines.size(), indices.size());
+
+	auto Worker = [&](VifEmulator<BitSize>* engine)
+	{
+		for (std::size_t n = nNext++; n < indices.size(); n = nNext++)
+		{
+			std::size_t i = indices[n];
+
+			budgets[i] = budget(i);
+
+			if (!engine->Resolve(jobs[i], budgets[i], results[i]))
+				continue;
+
+			//
+			// Only stubs that made it feed the adaptive budget, so a runaway stub can't raise it.
+			auto RaiseTo = [](std::atomic<std::uint64_t>& max, std::uint64_t value)
+			{
+				for (std::uint64_t cur = max.load(std::memory_order_relaxed); cur < value && !max.compare_exchange_weak(cur, value, std::memory_order_relaxed);)
+					;
+			};
+
+			RaiseTo(m_maxInstructions, engine->GetLastInstructions());
+			RaiseTo(m_maxMicroseconds, engine->GetLastMicroseconds());
+			m_resolved.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+
+	//
+	// The calling thread works too, so a single engine never spawns a thread.
+	for (std::size_t i = 1; i < nWorkers; ++i)
+		vecWorkers.emplace_back(Worker, m_engines[i].get());
+
+	if (nWorkers > 0)
+		Worker(m_engines[0].get());
+
+	for (auto& worker : vecWorkers)
+		worker.join();
+}
+
+template<size_t BitSize>
+void VifEmulatorPool<BitSize>::Resolve(const std::vector<VifStubJob_t>& jobs, std::vector<VifResolvedImport_t>& results, const VifBudget_t& budget)
+{
+	std::vector<std::size_t> vecIndices(jobs.size());
+	std::vector<VifBudget_t> vecBudgets(jobs.size());
+
+	results.clear();
+	results.resize(jobs.size());
+
+	for (std::size_t i = 0; i < jobs.size(); ++i)
+		vecIndices[i] = i;
+
+	_run(jobs, vecIndices, results, vecBudgets, [&](std::size_t) { return _budget(budget); });
+
+	//
+	// Slow stubs get their second try only once every other stub is done, so they never hold the fast ones up.
+	auto RetryBudget = [&](std::size_t)
+	{
+		return VifBudget_t{
+			budget.instructions ? budget.instructions * RETRY_FACTOR : MAX_BUDGET.instructions,
+			budget.microseconds ? budget.microseconds * RETRY_FACTOR : MAX_BUDGET.microseconds
+		};
+	};
+
+	vecIndices.clear();
+
+	for (std::size_t i = 0; i < jobs.size(); ++i)
+	{
+		if (results[i].failure != VifFailure::BudgetExceeded)
+			continue;
+
+		//
+		// Adaptive stubs that failed during the warmup already had all there is.
+		VifBudget_t retry = RetryBudget(i);
+
+		if (retry.instructions > vecBudgets[i].instructions || retry.microseconds > vecBudgets[i].microseconds)
+			vecIndices.push_back(i);
+	}
+
+	m_retried = vecIndices.size();
+
+	if (vecIndices.empty())
+		return;
+
+	logger->info("Retrying {} stubs that went over their budget", vecIndices.size());
+
+	_run(jobs, vecIndices, results, vecBudgets, RetryBudget);
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+class IVMPImportFixer;
+
+//! Counters for how much emulation work was saved by resolving per stub.
+struct VifResolutionStats_t
+{
+	std::size_t call_sites = 0;
+	std::size_t unique_stubs = 0;
+	std::size_t resolved_stubs = 0;
+	std::size_t pages_faulted = 0;
+	std::size_t bytes_read = 0;
+	std::size_t cache_hits = 0;
+	std::size_t cache_misses = 0;
+	std::size_t retried_stubs = 0;
+	//! Stubs resolved by the micro emulator, those it handed to Unicorn, and (when verifying) disagreements.
+	std::size_t fast_path_stubs = 0;
+	std::size_t fast_path_fallbacks = 0;
+	std::size_t fast_path_mismatches = 0;
+
+	double DeduplicationRatio() const noexcept {
+		return unique_stubs ? static_cast<double>(call_sites) / unique_stubs : 0.0;
+	}
+};
+
+//! Why a stub could not be resolved
+enum class VifFailure : std::uint8_t
+{
+	None,
+	//! Ran out of instructions or time
+	BudgetExceeded,
+	//! Touched memory outside of every module and the stack
+	UnmappedAccess,
+	//! Emulation ended without the stub ever leaving its image, e.g on an invalid instruction
+	NoReturn,
+	//! Left its image for an address that isn't inside any module
+	OutsideModules,
+	//! Returned into a module, but not to an export with a name
+	NoExport,
+	Count
+};
+
+inline const char* VifFailureName(VifFailure failure) noexcept
+{
+	switch (failure)
+	{
+	case VifFailure::None:				return "none";
+	case VifFailure::BudgetExceeded:	return "budget_exceeded";
+	case VifFailure::UnmappedAccess:	return "unmapped_access";
+	case VifFailure::NoReturn:			return "no_return";
+	case VifFailure::OutsideModules:	return "outside_modules";
+	case VifFailure::NoExport:			return "no_export";
+	default:							return "unknown";
+	}
+}
+
+//! How far a single stub may run, a limit of 0 is no limit.
+struct VifBudget_t
+{
+	std::uint64_t instructions = 0;
+	std::uint64_t microseconds = 0;
+};
+
+//! Result of emulating a single stub.
+struct VifResolvedImport_t
+{
+	bool				resolved = false;
+	VifFailure			failure = VifFailure::None;
+	std::string			module_name{};
+	pepp::ExportData_t	exp{};
+};
+
+template<size_t BitSize>
+class VifMicroEmulator;
+
+///
+//! class VifEmulator
+//! A single Unicorn instance, along with the context its hooks write results into.
+//! Stubs are tried on a VifMicroEmulator first, Unicorn only runs those it gives up on.
+///
+template<size_t BitSize>
+class VifEmulator : pepp::msc::NonCopyable
+{
+public:
+	using AddressType = typename pepp::detail::Image_t<BitSize>::Address_t;
+
+	//! Times a stub is restarted because it wrote to a read only page, each restart copies at least one page.
+	static constexpr std::size_t MAX_PROMOTIONS = 8;
+
+	VifEmulator(IVMPImportFixer* fixer) noexcept;
+	~VifEmulator();
+
+	//! Open the engine, map in the regions and install the hooks.
+	//! - The regions are mapped straight from their shared buffers, the stack is private to the engine.
+	//! - Pages of `lazy` are mapped the first time a stub reads or writes them (or fetches, if executable).
+	//! - The stack and the `writable` pages of `lazy` are private to the engine from the moment they are mapped.
+	//!   Any other page a stub writes to gets a private copy too, between runs: the stub is stopped, the page is
+	//!   swapped for a copy, and the stub runs again. Nothing that is mapped is ever remapped while a stub runs.
+	bool Initialize(const std::vector<VifMemoryRegion_t>& regions, const VifLazyMemoryMap* lazy, std::uint64_t stack_base, std::uint64_t stack_size) noexcept;
+
+	//! Emulate a single stub, stopping it once it goes over `budget`.
+	bool Resolve(const VifStubJob_t& job, const VifBudget_t& budget, VifResolvedImport_t& result) noexcept;
+
+	//! Use the micro emulator before Unicorn. With `verify`, Unicorn runs every stub anyway and has the final say,
+	//! any stub the two disagree on is logged.
+	void SetFastPath(bool enabled, bool verify) noexcept {
+		m_fastPath = enabled;
+		m_verify = verify;
+	}
+
+	std::size_t GetFastPathStubs() const noexcept {
+		return m_fastStubs;
+	}
+
+	std::size_t GetFastPathFallbacks() const noexcept {
+		return m_fastFallbacks;
+	}
+
+	std::size_t GetFastPathMismatches() const noexcept {
+		return m_fastMismatches;
+	}
+
+	//! Zero the pages faulted, fast path counters and histograms, so an engine that is kept around reports per run.
+	void ResetCounters() noexcept {
+		m_pagesFaulted = 0;
+		m_fastStubs = 0;
+		m_fastFallbacks = 0;
+		m_fastMismatches = 0;
+		m_instructionHistogram = {};
+		m_timeHistogram = {};
+	}
+
+	//! Instructions and microseconds the last stub took
+	std::uint64_t GetLastInstructions() const noexcept {
+		return m_stubInstructions;
+	}
+
+	std::uint64_t GetLastMicroseconds() const noexcept {
+		return m_stubMicroseconds;
+	}
+
+	//! Number of pages mapped on demand so far
+	std::size_t GetPagesFaulted() const noexcept {
+		return m_pagesFaulted;
+	}
+
+	//! Instructions emulated per stub
+	const VifHistogram& GetInstructionHistogram() const noexcept {
+		return m_instructionHistogram;
+	}
+
+	//! Microseconds spent per stub
+	const VifHistogram& GetTimeHistogram() const noexcept {
+		return m_timeHistogram;
+	}
+
+private:
+	//! A guest page stubs may write to, backed by memory owned by the engine.
+	struct OverlayPage_t
+	{
+		std::unique_ptr<std::uint8_t[]>	data;
+		const std::uint8_t*				source;
+		std::uint32_t					perms;
+	};
+
+	//! Maps lazy pages in. A fetch that can't be satisfied means the stub left the image, the fetch address is the import.
+	static bool MemUnmappedHook(uc_engine* uc, uc_mem_type type, uint64_t address, int size, int64_t value, void* user_data);
+
+	//! A fetch from a non executable page (another module's), also the stub leaving the image.
+	static bool FetchProtHook(uc_engine* uc, uc_mem_type type, uint64_t address, int size, int64_t value, void* user_data);
+
+	//! Records what a stub wrote: the lowest stack address, and the pages outside the stack. Only installed over the
+	//! stack and the span of writable pages, it never maps or unmaps anything.
+	static void WriteHook(uc_engine* uc, uc_mem_type type, uint64_t address, int size, int64_t value, void* user_data);
+
+	//! A write to a page mapped read only. The page is noted down for PromotePage, and the stub stopped.
+	static bool WriteProtHook(uc_engine* uc, uc_mem_type type, uint64_t address, int size, int64_t value, void* user_data);
+
+	//! Counts the instructions of every block and enforces the budget. If more than one module is executable,
+	//! also catches a stub leaving its own image for another one.
+	static void BlockHook(uc_engine* uc, uint64_t address, uint32_t size, void* user_data);
+
+	//! Number of instructions in a block, decoded once per block address.
+	std::uint32_t CountInstructions(std::uint64_t address, std::uint32_t size) noexcept;
+
+	//! Map a single page of the lazy map, returns nullptr if it is not part of it.
+	//! A writable page is mapped as a private copy right away.
+	const VifMemoryRegion_t* MapLazyPage(std::uint64_t page) noexcept;
+
+	//! Swap a read only page, mapped up front or on demand, for a private writable copy. Never called from a hook.
+	bool PromotePage(std::uint64_t page) noexcept;
+
+	//! Restore what the last stub wrote on the stack and its private pages, clearing the dirty list.
+	void ResetPrivatePages() noexcept;
+
+	//! Find the export a stub left its image for
+	bool ResolveExit(std::uint64_t exit_address, VifResolvedImport_t& result) noexcept;
+
+	uc_engine*							m_uc = nullptr;
+	uc_hook								m_unmappedHook{};
+	uc_hook								m_fetchProtHook{};
+	uc_hook								m_blockHook{};
+	uc_hook								m_stackWriteHook{};
+	uc_hook								m_privateWriteHook{};
+	uc_hook								m_writeProtHook{};
+	uc_context*							m_context = nullptr;
+	ZydisDecoder						m_decoder{};
+	IVMPImportFixer*					m_fixer;
+	AddressType							m_stack{};
+	std::vector<VifMemoryRegion_t>		m_regions;
+	const VifLazyMemoryMap*				m_lazy = nullptr;
+	//! Lazy pages mapped so far, they stay mapped for every stub after.
+	std::unordered_set<std::uint64_t>	m_lazyPages;
+	std::size_t							m_pagesFaulted = 0;
+	//! The stack, private to the engine and mapped writable
+	std::vector<std::uint8_t>			m_stackSource;
+	std::uint64_t						m_stackBase = 0;
+	//! Lowest stack address written since the last reset, the stack is clean below it.
+	std::uint64_t						m_stackLow = 0;
+	//! Private copies of writable lazy pages, by guest page address
+	std::unordered_map<std::uint64_t, OverlayPage_t> m_privatePages;
+	//! Pages outside the stack written since the last reset, a stub only ever writes a few.
+	std::vector<std::uint64_t>			m_dirtyPages;
+	//! Span the private write hook covers, pages copied outside of it get a hook of their own.
+	std::uint64_t						m_writableBegin = 0;
+	std::uint64_t						m_writableEnd = 0;
+	//! Read only pages the running stub tried to write to
+	std::vector<std::uint64_t>			m_promotePages;
+	//! The stub currently being emulated, and what the hooks found.
+	const VifStubJob_t*					m_job = nullptr;
+	AddressType							m_exitAddress{};
+	bool								m_exited = false;
+	//! Block hook also checks the stub's image range
+	bool								m_checkImage = false;
+	//! Instruction counts of blocks seen so far, by block address. Blocks are re-counted if their size changes.
+	std::unordered_map<std::uint64_t, std::pair<std::uint32_t, std::uint32_t>> m_blockInstructions;
+	std::vector<std::uint8_t>			m_blockBuffer;
+	std::uint64_t						m_stubInstructions = 0;
+	std::uint64_t						m_stubMicroseconds = 0;
+	std::uint64_t						m_stubBlocks = 0;
+	VifBudget_t							m_budget{};
+	std::chrono::steady_clock::time_point m_deadline{};
+	bool								m_budgetExceeded = false;
+	std::unique_ptr<VifMicroEmulator<BitSize>> m_micro;
+	bool								m_fastPath = true;
+	bool								m_verify = false;
+	std::size_t							m_fastStubs = 0;
+	std::size_t							m_fastFallbacks = 0;
+	std::size_t							m_fastMismatches = 0;
+	//! Only touched by the thread driving the engine, merged once emulation is done.
+	VifHistogram						m_instructionHistogram;
+	VifHistogram						m_timeHistogram;
+};
+
+///
+//! class VifEmulatorPool
+//! One engine per worker, call sites are handed out to the workers from a shared counter.
+///
+template<size_t BitSize>
+class VifEmulatorPool : pepp::msc::NonCopyable
+{
+public:
+	//! `workers` of 0 uses one engine per hardware thread.
+	VifEmulatorPool(IVMPImportFixer* fixer, std::size_t workers = 0) noexcept;
+
+	bool Initialize(const std::vector<VifMemoryRegion_t>& regions, const VifLazyMemoryMap* lazy, std::uint64_t stack_base, std::uint64_t stack_size) noexcept;
+
+	//! Adaptive budgets start out at MAX_BUDGET, after WARMUP_STUBS resolved stubs they drop to BUDGET_FACTOR
+	//! times the most any resolved stub took so far (but no lower than MIN_BUDGET).
+	static constexpr std::uint64_t WARMUP_STUBS = 32;
+	static constexpr std::uint64_t BUDGET_FACTOR = 8;
+	static constexpr VifBudget_t MIN_BUDGET{ 100'000, 50'000 };
+	static constexpr VifBudget_t MAX_BUDGET{ 50'000'000, 5'000'000 };
+	//! A fixed budget is multiplied by this on the retry, an adaptive one goes up to MAX_BUDGET.
+	static constexpr std::uint64_t RETRY_FACTOR = 16;
+
+	//! Resolve all stubs, `results[i]` always belongs to `jobs[i]` regardless of which worker ran it.
+	//! - Limits of `budget` that are 0 are picked from the stubs resolved so far.
+	//! - Stubs that run out of budget are retried once with a larger one, after every other stub is done.
+	void Resolve(const std::vector<VifStubJob_t>& jobs, std::vector<VifResolvedImport_t>& results, const VifBudget_t& budget = {});
+
+	std::size_t size() const noexcept {
+		return m_engines.size();
+	}
+
+	//! Pages mapped on demand, across every engine
+	std::size_t GetPagesFaulted() const noexcept;
+
+	//! Per stub histograms, merged across every engine
+	VifHistogram GetInstructionHistogram() const noexcept;
+	VifHistogram GetTimeHistogram() const noexcept;
+
+	//! Stubs that got a second try with a larger budget
+	std::size_t GetRetriedStubs() const noexcept {
+		return m_retried;
+	}
+
+	void SetFastPath(bool enabled, bool verify) noexcept;
+
+	//! Start counting afresh on every engine, for a pool that is kept across runs.
+	//! The adaptive budget is kept, it only gets better with more stubs.
+	void ResetCounters() noexcept;
+
+	//! Fast path counters, summed across every engine
+	void GetFastPathStats(VifResolutionStats_t& stats) const noexcept;
+
+private:
+	//! Budget for the next stub, given what was asked for
+	VifBudget_t _budget(const VifBudget_t& budget) const noexcept;
+
+	//! Run the `indices` of `jobs` across the engines, `budgets[i]` (set before jobs[i] runs) is what it may use.
+	void _run(const std::vector<VifStubJob_t>& jobs, const std::vector<std::size_t>& indices, std::vector<VifResolvedImport_t>& results,
+		std::vector<VifBudget_t>& budgets, const std::function<VifBudget_t(std::size_t)>& budget);
+
+	IVMPImportFixer*									m_fixer;
+	std::vector<std::unique_ptr<VifEmulator<BitSize>>>	m_engines;
+	//! What the adaptive budget is taken from, only resolved stubs count.
+	std::atomic<std::uint64_t>							m_resolved{ 0 };
+	std::atomic<std::uint64_t>							m_maxInstructions{ 0 };
+	std::atomic<std::uint64_t>							m_maxMicroseconds{ 0 };
+	std::size_t											m_retried = 0;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+//
+// Guest memory as the engines and the micro emulator see it. Only the standard library and the Unicorn
+// protection flags, so the micro emulator can be built and tested without the rest of the fixer.
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <unicorn/unicorn.h>
+#include "msc/AddressSpaceMap.hpp"
+#include "VIFCallScanner.hpp"
+
+//! Guest memory handed to every engine, `data` (`size` bytes, page aligned) is shared and only ever read.
+struct VifMemoryRegion_t
+{
+	std::uint64_t		address;
+	std::uint64_t		size;
+	const std::uint8_t*	data;
+	//! Permissions the region is mapped with, pages in `writable` additionally get UC_PROT_WRITE.
+	std::uint32_t		perms = UC_PROT_READ | UC_PROT_EXEC;
+	//! Lazy regions without `data` get their pages from here (by offset into the region), the page has to outlive the engines.
+	std::function<const std::uint8_t*(std::uint64_t offset)> fetch{};
+	//! Offsets stubs may write to, e.g the region's writable sections. Every engine maps its own copy of these
+	//! pages, writable from the start. A page written anywhere else is copied once the stub hits it.
+	std::vector<VifRvaRange_t> writable{};
+
+	//! Shared contents of a page of the region, nullptr if it can't be had.
+	const std::uint8_t* GetPage(std::uint64_t page) const {
+		return data ? data + (page - address) : fetch ? fetch(page - address) : nullptr;
+	}
+
+	//! Whether a page of the region gets a private, writable copy
+	bool IsWritable(std::uint64_t page) const {
+		return std::any_of(writable.begin(), writable.end(), [offset = page - address](const VifRvaRange_t& range) { return offset >= range.begin && offset < range.end; });
+	}
+};
+
+//! Memory that is only mapped once a stub touches it, a page at a time.
+using VifLazyMemoryMap = vif::AddressSpaceMap<VifMemoryRegion_t>;
+
+//! A stub to emulate, as if it was just called with `return_address` on the stack.
+struct VifStubJob_t
+{
+	std::uint64_t	stub;
+	std::uint64_t	return_address;
+	//! Range of the module the stub belongs to, leaving it is the way out of the stub.
+	std::uint64_t	image_begin;
+	std::uint64_t	image_end;
+};
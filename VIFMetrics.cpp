@@ -0,0 +1,166 @@
+#include "VMPImportFixer.hpp"
+#include <bit>
+#include <fstream>
+
+namespace
+{
+	//! Find an entry by name, adding it if it isn't there yet.
+	template<typename T>
+	T& FindOrAdd(std::vector<std::pair<std::string, T>>& entries, std::string_view name)
+	{
+		for (auto& [key, value] : entries)
+		{
+			if (key == name)
+				return value;
+		}
+
+		return entries.emplace_back(std::string(name), T{}).second;
+	}
+}
+
+void VifHistogram::Add(std::uint64_t value) noexcept
+{
+	++m_buckets[std::min<std::size_t>(std::bit_width(value), BUCKETS - 1)];
+	++m_count;
+	m_sum += value;
+	m_max = std::max(m_max, value);
+}
+
+void VifHistogram::Merge(const VifHistogram& other) noexcept
+{
+	for (std::size_t i = 0; i < BUCKETS; ++i)
+		m_buckets[i] += other.m_buckets[i];
+
+	m_count += other.m_count;
+	m_sum += other.m_sum;
+	m_max = std::max(m_max, other.m_max);
+}
+
+std::uint64_t VifHistogram::Percentile(double p) const noexcept
+{
+	std::uint64_t uRank = static_cast<std::uint64_t>(p * m_count);
+	std::uint64_t uSeen = 0;
+
+	for (std::size_t i = 0; i < BUCKETS; ++i)
+	{
+		uSeen += m_buckets[i];
+
+		if (uSeen > uRank)
+			return i == 0 ? 0 : std::min(m_max, (std::uint64_t(1) << i) - 1);
+	}
+
+	return m_max;
+}
+
+void VifMetrics::AddPhase(std::string_view name, double seconds)
+{
+	std::lock_guard lock(m_lock);
+	FindOrAdd(m_phases, name) += seconds;
+}
+
+void VifMetrics::AddCounter(std::string_view name, std::uint64_t value)
+{
+	std::lock_guard lock(m_lock);
+	FindOrAdd(m_counters, name) += value;
+}
+
+void VifMetrics::AddHistogram(std::string_view name, const VifHistogram& histogram)
+{
+	std::lock_guard lock(m_lock);
+	FindOrAdd(m_histograms, name).Merge(histogram);
+}
+
+std::uint64_t VifMetrics::GetPeakMemory() noexcept
+{
+	PROCESS_MEMORY_COUNTERS pmc{};
+
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+
+	return pmc.PeakWorkingSetSize;
+}
+
+void VifMetrics::Clear()
+{
+	std::lock_guard lock(m_lock);
+	m_phases.clear();
+	m_counters.clear();
+	m_histograms.clear();
+}
+
+double VifMetrics::GetPhase(std::string_view name) const
+{
+	std::lock_guard lock(m_lock);
+	auto it = std::find_if(m_phases.begin(), m_phases.end(), [name](const auto& phase) { return phase.first == name; });
+
+	return it != m_phases.end() ? it->second : 0.0;
+}
+
+std::uint64_t VifMetrics::GetCounter(std::string_view name) const
+{
+	std::lock_guard lock(m_lock);
+	auto it = std::find_if(m_counters.begin(), m_counters.end(), [name](const auto& counter) { return counter.first == name; });
+
+	return it != m_counters.end() ? it->second : 0;
+}
+
+std::string VifMetrics::ToJson(bool compact) const
+{
+	std::lock_guard lock(m_lock);
+	std::string sJson;
+
+	//
+	// Line breaks and indentation are the only difference.
+	auto Line = [compact](std::size_t indent) { return compact ? std::string() : "\n" + std::string(indent, ' '); };
+
+	//
+	// Names are all fixed identifiers, nothing needs escaping.
+	sJson += "{" + Line(2) + "\"phases\": {";
+
+	for (std::size_t i = 0; i < m_phases.size(); ++i)
+		sJson += (i ? "," : "") + Line(4) + fmt::format("\"{}\": {:.6f}", m_phases[i].first, m_phases[i].second);
+
+	sJson += Line(2) + "}," + Line(2) + "\"counters\": {";
+
+	for (std::size_t i = 0; i < m_counters.size(); ++i)
+		sJson += (i ? "," : "") + Line(4) + fmt::format("\"{}\": {}", m_counters[i].first, m_counters[i].second);
+
+	sJson += Line(2) + "}," + Line(2) + "\"histograms\": {";
+
+	for (std::size_t i = 0; i < m_histograms.size(); ++i)
+	{
+		const VifHistogram& h = m_histograms[i].second;
+
+		sJson += (i ? "," : "") + Line(4) + fmt::format("\"{}\": {{ \"count\": {}, \"sum\": {}, \"max\": {}, \"p50\": {}, \"p90\": {}, \"p99\": {}, \"buckets\": [",
+			m_histograms[i].first, h.count(), h.sum(), h.max(), h.Percentile(0.5), h.Percentile(0.9), h.Percentile(0.99));
+
+		//
+		// Only buckets with something in them, as [upper bound, count].
+		bool bFirst = true;
+
+		for (std::size_t b = 0; b < VifHistogram::BUCKETS; ++b)
+		{
+			if (h.buckets()[b] == 0)
+				continue;
+
+			sJson += (bFirst ? "" : ", ") + fmt::format("[{}, {}]", b == 0 ? 0 : (std::uint64_t(1) << b) - 1, h.buckets()[b]);
+			bFirst = false;
+		}
+
+		sJson += "] }";
+	}
+
+	sJson += Line(2) + "}," + Line(2) + fmt::format("\"peak_memory\": {}", GetPeakMemory()) + Line(0) + "}";
+	return sJson;
+}
+
+bool VifMetrics::WriteJson(std::string_view path) const
+{
+	std::ofstream file(std::string(path), std::ios::trunc);
+
+	if (!file.is_open())
+		return false;
+
+	file << ToJson() << "\n";
+	return file.good();
+}
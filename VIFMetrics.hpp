@@ -0,0 +1,105 @@
+#pragma once
+
+///
+//! class VifHistogram
+//! Power of two buckets, cheap enough to feed from every stub. Not thread safe, keep one per thread and Merge().
+///
+class VifHistogram
+{
+public:
+	static constexpr std::size_t BUCKETS = 64;
+
+	void Add(std::uint64_t value) noexcept;
+	void Merge(const VifHistogram& other) noexcept;
+
+	//! Upper bound of the bucket holding the `p`th percentile (0.0 - 1.0)
+	std::uint64_t Percentile(double p) const noexcept;
+
+	std::uint64_t count() const noexcept {
+		return m_count;
+	}
+
+	std::uint64_t sum() const noexcept {
+		return m_sum;
+	}
+
+	std::uint64_t max() const noexcept {
+		return m_max;
+	}
+
+	//! Bucket `i` holds values in [2^(i-1), 2^i), bucket 0 only holds 0.
+	const std::array<std::uint64_t, BUCKETS>& buckets() const noexcept {
+		return m_buckets;
+	}
+
+private:
+	std::array<std::uint64_t, BUCKETS>	m_buckets{};
+	std::uint64_t						m_count = 0;
+	std::uint64_t						m_sum = 0;
+	std::uint64_t						m_max = 0;
+};
+
+///
+//! class VifMetrics
+//! Everything measured during a run. Workers keep their own counters, only the totals are handed in here.
+///
+class VifMetrics : pepp::msc::NonCopyable
+{
+public:
+	//! Add time to a phase, phases hit more than once (or from several threads) add up.
+	void AddPhase(std::string_view name, double seconds);
+
+	//! Add to a counter
+	void AddCounter(std::string_view name, std::uint64_t value);
+
+	void AddHistogram(std::string_view name, const VifHistogram& histogram);
+
+	//! Seconds spent in a phase, 0 if it was never hit.
+	double GetPhase(std::string_view name) const;
+
+	//! Value of a counter, 0 if it was never added to.
+	std::uint64_t GetCounter(std::string_view name) const;
+
+	//! Peak working set of this process so far
+	static std::uint64_t GetPeakMemory() noexcept;
+
+	//! Forget everything added so far, for the next run.
+	void Clear();
+
+	//! Every phase, counter and histogram as JSON, `compact` puts it all on a single line.
+	std::string ToJson(bool compact = false) const;
+
+	//! Write ToJson() out to a file.
+	bool WriteJson(std::string_view path) const;
+
+private:
+	mutable std::mutex												m_lock;
+	//! In the order they were first hit
+	std::vector<std::pair<std::string, double>>						m_phases;
+	std::vector<std::pair<std::string, std::uint64_t>>				m_counters;
+	std::vector<std::pair<std::string, VifHistogram>>				m_histograms;
+};
+
+///
+//! class VifScopedPhase
+//! Times a phase from construction to destruction.
+///
+class VifScopedPhase : pepp::msc::NonCopyable
+{
+public:
+	VifScopedPhase(VifMetrics& metrics, std::string_view name) noexcept
+		: m_metrics(metrics)
+		, m_name(name)
+	{
+	}
+
+	~VifScopedPhase()
+	{
+		m_metrics.AddPhase(m_name, std::chrono::duration<double>(m_sw.elapsed()).count());
+	}
+
+private:
+	VifMetrics&			m_metrics;
+	std::string_view	m_name;
+	spdlog::stopwatch	m_sw;
+};
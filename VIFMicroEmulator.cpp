@@ -0,0 +1,473 @@
+#include "VIFMicroEmulator.hpp"
+#include <cstdlib>
+#include <cstring>
+
+// Explicit templates.
+template class VifMicroEmulator<32>;
+template class VifMicroEmulator<64>;
+
+namespace
+{
+	constexpr std::uint64_t WidthMask(std::size_t bits) noexcept
+	{
+		return bits >= 64 ? ~0ull : (1ull << bits) - 1;
+	}
+
+	std::uint64_t ByteSwap(std::uint64_t value, std::size_t bits) noexcept
+	{
+#ifdef _MSC_VER
+		return bits == 64 ? _byteswap_uint64(value) : _byteswap_ulong(static_cast<unsigned long>(value));
+#else
+		return bits == 64 ? __builtin_bswap64(value) : __builtin_bswap32(static_cast<std::uint32_t>(value));
+#endif
+	}
+
+	constexpr std::uint64_t SignExtend(std::uint64_t value, std::size_t bits) noexcept
+	{
+		return bits >= 64 ? value : (value & WidthMask(bits)) | ((value >> (bits - 1)) & 1 ? ~WidthMask(bits) : 0);
+	}
+}
+
+template<size_t BitSize>
+VifMicroEmulator<BitSize>::VifMicroEmulator(const ZydisDecoder* decoder) noexcept
+	: m_decoder(decoder)
+{
+}
+
+template<size_t BitSize>
+void VifMicroEmulator<BitSize>::Initialize(const std::vector<VifMemoryRegion_t>* regions, const VifLazyMemoryMap* lazy,
+	std::uint64_t stack_base, std::uint64_t stack_size, std::uint64_t stack_pointer)
+{
+	m_regions = regions;
+	m_lazy = lazy;
+	m_stackBase = stack_base;
+	m_stackPointer = stack_pointer;
+	m_stack.assign(stack_size, 0);
+	m_dirtyBegin = m_stack.size();
+	m_dirtyEnd = 0;
+}
+
+template<size_t BitSize>
+bool VifMicroEmulator<BitSize>::Run(const VifStubJob_t& job, std::uint64_t max_instructions, std::uint64_t& exit_address) noexcept
+{
+	static constexpr std::size_t SP_INDEX = 4;
+
+	//
+	// Same starting state as the engine: every register zeroed, a fresh stack, and the return address on top of it.
+	if (m_dirtyBegin < m_dirtyEnd)
+		std::memset(m_stack.data() + m_dirtyBegin, 0, m_dirtyEnd - m_dirtyBegin);
+
+	m_dirtyBegin = m_stack.size();
+	m_dirtyEnd = 0;
+	m_gpr.fill(0);
+	m_gpr[SP_INDEX] = m_stackPointer;
+	m_rip = job.stub;
+	m_instructions = 0;
+
+	AddressType rtnaddress = static_cast<AddressType>(job.return_address);
+
+	if (!_write(m_stackPointer, &rtnaddress, sizeof(rtnaddress)))
+		return false;
+
+	std::uint8_t buffer[ZYDIS_MAX_INSTRUCTION_LENGTH];
+	ZydisDecodedInstruction insn;
+
+	for (; m_instructions < std::min(max_instructions, MAX_INSTRUCTIONS); ++m_instructions)
+	{
+		//
+		// Leaving the image is the way out, the same as for the engine.
+		if (m_rip < job.image_begin || m_rip >= job.image_end)
+		{
+			exit_address = m_rip;
+			return true;
+		}
+
+		//
+		// An instruction can end right before an unmapped page, only read what's there.
+		std::size_t nFetch = sizeof(buffer);
+
+		if (!_read(m_rip, buffer, nFetch))
+		{
+			nFetch = std::min<std::size_t>(nFetch, GUEST_PAGE_SIZE - (m_rip & (GUEST_PAGE_SIZE - 1)));
+
+			if (!_read(m_rip, buffer, nFetch))
+				return false;
+		}
+
+		if (!ZYAN_SUCCESS(ZydisDecoderDecodeBuffer(m_decoder, buffer, nFetch, &insn)) || !_step(insn))
+			return false;
+	}
+
+	return false;
+}
+
+template<size_t BitSize>
+bool VifMicroEmulator<BitSize>::_step(const ZydisDecodedInstruction& insn) noexcept
+{
+	std::uint8_t nExplicit = 0;
+
+	while (nExplicit < insn.operand_count && insn.operands[nExplicit].visibility == ZYDIS_OPERAND_VISIBILITY_EXPLICIT)
+		++nExplicit;
+
+	const ZydisDecodedOperand& op0 = insn.operands[0];
+	const ZydisDecodedOperand& op1 = insn.operands[1];
+	std::uint64_t uNext = (m_rip + insn.length) & ADDRESS_MASK;
+	std::uint64_t a = 0, b = 0;
+
+	auto Binary = [&](auto fn)
+	{
+		if (nExplicit != 2 || !_get(insn, op0, a) || !_get(insn, op1, b))
+			return false;
+
+		return _set(insn, op0, fn(a, b));
+	};
+
+	auto Unary = [&](auto fn)
+	{
+		if (nExplicit != 1 || !_get(insn, op0, a))
+			return false;
+
+		return _set(insn, op0, fn(a));
+	};
+
+	//
+	// Flags are never tracked, anything reading them (jcc, adc, cmov, pushf...) isn't supported.
+	switch (insn.mnemonic)
+	{
+	case ZYDIS_MNEMONIC_NOP:
+		break;
+	case ZYDIS_MNEMONIC_MOV:
+		if (!Binary([](std::uint64_t, std::uint64_t y) { return y; }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_MOVZX:
+		if (!Binary([&](std::uint64_t, std::uint64_t y) { return y & WidthMask(op1.size); }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_MOVSX:
+	case ZYDIS_MNEMONIC_MOVSXD:
+		if (!Binary([&](std::uint64_t, std::uint64_t y) { return SignExtend(y, op1.size); }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_LEA:
+		if (nExplicit != 2 || op1.type != ZYDIS_OPERAND_TYPE_MEMORY || !_address(insn, op1, b) || !_set(insn, op0, b))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_ADD:
+		if (!Binary([](std::uint64_t x, std::uint64_t y) { return x + y; }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_SUB:
+		if (!Binary([](std::uint64_t x, std::uint64_t y) { return x - y; }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_XOR:
+		if (!Binary([](std::uint64_t x, std::uint64_t y) { return x ^ y; }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_AND:
+		if (!Binary([](std::uint64_t x, std::uint64_t y) { return x & y; }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_OR:
+		if (!Binary([](std::uint64_t x, std::uint64_t y) { return x | y; }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_NOT:
+		if (!Unary([](std::uint64_t x) { return ~x; }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_NEG:
+		if (!Unary([](std::uint64_t x) { return 0 - x; }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_INC:
+		if (!Unary([](std::uint64_t x) { return x + 1; }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_DEC:
+		if (!Unary([](std::uint64_t x) { return x - 1; }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_BSWAP:
+		if ((op0.size != 32 && op0.size != 64) ||
+			!Unary([&](std::uint64_t x) { return ByteSwap(x, op0.size); }))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_SHL:
+	case ZYDIS_MNEMONIC_SHR:
+	case ZYDIS_MNEMONIC_SAR:
+	case ZYDIS_MNEMONIC_ROL:
+	case ZYDIS_MNEMONIC_ROR:
+	{
+		//
+		// The count is masked to 5 bits (6 for 64bit operands) before anything else, rotates then wrap around the operand size.
+		std::size_t nBits = op0.size;
+
+		if (!Binary([&](std::uint64_t x, std::uint64_t y)
+			{
+				std::uint64_t n = y & (nBits == 64 ? 0x3f : 0x1f);
+
+				x &= WidthMask(nBits);
+
+				switch (insn.mnemonic)
+				{
+				case ZYDIS_MNEMONIC_SHL:	return n >= nBits ? 0 : x << n;
+				case ZYDIS_MNEMONIC_SHR:	return n >= nBits ? 0 : x >> n;
+				case ZYDIS_MNEMONIC_SAR:	return static_cast<std::uint64_t>(static_cast<std::int64_t>(SignExtend(x, nBits)) >> std::min<std::uint64_t>(n, 63));
+				default:
+					n %= nBits;
+					if (n == 0)
+						return x;
+					return insn.mnemonic == ZYDIS_MNEMONIC_ROL ? (x << n) | (x >> (nBits - n)) : (x >> n) | (x << (nBits - n));
+				}
+			}))
+			return false;
+		break;
+	}
+	case ZYDIS_MNEMONIC_XCHG:
+		if (nExplicit != 2 || !_get(insn, op0, a) || !_get(insn, op1, b) || !_set(insn, op0, b) || !_set(insn, op1, a))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_PUSH:
+		if (nExplicit != 1 || !_get(insn, op0, a) || !_push(a, insn.operand_width / 8))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_POP:
+		if (nExplicit != 1 || op0.type != ZYDIS_OPERAND_TYPE_REGISTER || !_pop(a, insn.operand_width / 8) || !_set(insn, op0, a))
+			return false;
+		break;
+	case ZYDIS_MNEMONIC_JMP:
+		if (nExplicit != 1)
+			return false;
+
+		if (op0.type == ZYDIS_OPERAND_TYPE_IMMEDIATE && op0.imm.is_relative)
+			a = uNext + op0.imm.value.u;
+		else if (op0.type == ZYDIS_OPERAND_TYPE_IMMEDIATE || !_get(insn, op0, a))
+			return false;
+
+		m_rip = a & ADDRESS_MASK;
+		return true;
+	case ZYDIS_MNEMONIC_RET:
+		if (!_pop(a, insn.operand_width / 8))
+			return false;
+
+		if (nExplicit == 1)
+			m_gpr[4] = (m_gpr[4] + op0.imm.value.u) & ADDRESS_MASK;
+
+		m_rip = a & ADDRESS_MASK;
+		return true;
+	default:
+		return false;
+	}
+
+	m_rip = uNext;
+	return true;
+}
+
+template<size_t BitSize>
+bool VifMicroEmulator<BitSize>::_read(std::uint64_t address, void* buffer, std::size_t size) const noexcept
+{
+	std::uint8_t* pBuffer = static_cast<std::uint8_t*>(buffer);
+
+	while (size > 0)
+	{
+		std::uint64_t page = address & ~(std::uint64_t)(GUEST_PAGE_SIZE - 1);
+		std::size_t nChunk = std::min<std::size_t>(size, GUEST_PAGE_SIZE - (address - page));
+		const std::uint8_t* pSource = nullptr;
+
+		if (address >= m_stackBase && address + nChunk <= m_stackBase + m_stack.size())
+		{
+			pSource = m_stack.data() + (address - m_stackBase);
+		}
+		else
+		{
+			for (auto& region : *m_regions)
+			{
+				if (page >= region.address && page < region.address + region.size)
+				{
+					pSource = region.GetPage(page);
+					break;
+				}
+			}
+
+			if (pSource == nullptr)
+			{
+				const VifMemoryRegion_t* region = m_lazy ? m_lazy->FindValue(page) : nullptr;
+
+				if (region == nullptr || (pSource = region->GetPage(page)) == nullptr)
+					return false;
+			}
+
+			pSource += address - page;
+		}
+
+		std::memcpy(pBuffer, pSource, nChunk);
+
+		pBuffer += nChunk;
+		address += nChunk;
+		size -= nChunk;
+	}
+
+	return true;
+}
+
+template<size_t BitSize>
+bool VifMicroEmulator<BitSize>::_write(std::uint64_t address, const void* buffer, std::size_t size) noexcept
+{
+	//
+	// Writes anywhere but the stack are left to the engine, which gives pages private copies.
+	if (address < m_stackBase || address + size > m_stackBase + m_stack.size())
+		return false;
+
+	std::size_t offset = static_cast<std::size_t>(address - m_stackBase);
+
+	std::memcpy(m_stack.data() + offset, buffer, size);
+
+	m_dirtyBegin = std::min(m_dirtyBegin, offset);
+	m_dirtyEnd = std::max(m_dirtyEnd, offset + size);
+	return true;
+}
+
+template<size_t BitSize>
+bool VifMicroEmulator<BitSize>::_push(std::uint64_t value, std::size_t size) noexcept
+{
+	std::uint64_t sp = (m_gpr[4] - size) & ADDRESS_MASK;
+
+	if (!_write(sp, &value, size))
+		return false;
+
+	m_gpr[4] = sp;
+	return true;
+}
+
+template<size_t BitSize>
+bool VifMicroEmulator<BitSize>::_pop(std::uint64_t& value, std::size_t size) noexcept
+{
+	value = 0;
+
+	if (!_read(m_gpr[4], &value, size))
+		return false;
+
+	m_gpr[4] = (m_gpr[4] + size) & ADDRESS_MASK;
+	return true;
+}
+
+template<size_t BitSize>
+std::uint64_t* VifMicroEmulator<BitSize>::_register(ZydisRegister reg) noexcept
+{
+	static constexpr ZydisMachineMode MACHINE_MODE = BitSize == 32 ? ZYDIS_MACHINE_MODE_LONG_COMPAT_32 : ZYDIS_MACHINE_MODE_LONG_64;
+	static constexpr ZydisRegisterClass REGISTER_CLASS = BitSize == 32 ? ZYDIS_REGCLASS_GPR32 : ZYDIS_REGCLASS_GPR64;
+
+	if (reg == ZYDIS_REGISTER_AH || reg == ZYDIS_REGISTER_CH || reg == ZYDIS_REGISTER_DH || reg == ZYDIS_REGISTER_BH)
+		return nullptr;
+
+	ZydisRegister largest = ZydisRegisterGetLargestEnclosing(MACHINE_MODE, reg);
+
+	if (ZydisRegisterGetClass(largest) != REGISTER_CLASS)
+		return nullptr;
+
+	ZyanI8 id = ZydisRegisterGetId(largest);
+
+	return id >= 0 && static_cast<std::size_t>(id) < m_gpr.size() ? &m_gpr[id] : nullptr;
+}
+
+template<size_t BitSize>
+bool VifMicroEmulator<BitSize>::_address(const ZydisDecodedInstruction& insn, const ZydisDecodedOperand& op, std::uint64_t& address) noexcept
+{
+	static constexpr ZydisMachineMode MACHINE_MODE = BitSize == 32 ? ZYDIS_MACHINE_MODE_LONG_COMPAT_32 : ZYDIS_MACHINE_MODE_LONG_64;
+
+	//
+	// FS/GS point at the TEB, which isn't mapped for the engine either.
+	if (op.mem.segment == ZYDIS_REGISTER_FS || op.mem.segment == ZYDIS_REGISTER_GS)
+		return false;
+
+	address = op.mem.disp.has_displacement ? static_cast<std::uint64_t>(op.mem.disp.value) : 0;
+
+	if (op.mem.base == ZYDIS_REGISTER_RIP || op.mem.base == ZYDIS_REGISTER_EIP)
+	{
+		address += m_rip + insn.length;
+	}
+	else if (op.mem.base != ZYDIS_REGISTER_NONE)
+	{
+		std::uint64_t* pBase = _register(op.mem.base);
+		if (pBase == nullptr)
+			return false;
+
+		address += *pBase & WidthMask(ZydisRegisterGetWidth(MACHINE_MODE, op.mem.base));
+	}
+
+	if (op.mem.index != ZYDIS_REGISTER_NONE)
+	{
+		std::uint64_t* pIndex = _register(op.mem.index);
+		if (pIndex == nullptr)
+			return false;
+
+		address += (*pIndex & WidthMask(ZydisRegisterGetWidth(MACHINE_MODE, op.mem.index))) * op.mem.scale;
+	}
+
+	address &= WidthMask(insn.address_width);
+	return true;
+}
+
+template<size_t BitSize>
+bool VifMicroEmulator<BitSize>::_get(const ZydisDecodedInstruction& insn, const ZydisDecodedOperand& op, std::uint64_t& value) noexcept
+{
+	switch (op.type)
+	{
+	case ZYDIS_OPERAND_TYPE_REGISTER:
+	{
+		std::uint64_t* pReg = _register(op.reg.value);
+		if (pReg == nullptr)
+			return false;
+
+		value = *pReg & WidthMask(op.size);
+		return true;
+	}
+	case ZYDIS_OPERAND_TYPE_MEMORY:
+	{
+		std::uint64_t address;
+
+		value = 0;
+		return op.mem.type == ZYDIS_MEMOP_TYPE_MEM && op.size >= 8 && op.size <= 64 && _address(insn, op, address) && _read(address, &value, op.size / 8);
+	}
+	case ZYDIS_OPERAND_TYPE_IMMEDIATE:
+		//
+		// Signed immediates come sign extended, they're cut to the destination's size on write.
+		value = op.imm.value.u;
+		return !op.imm.is_relative;
+	default:
+		return false;
+	}
+}
+
+template<size_t BitSize>
+bool VifMicroEmulator<BitSize>::_set(const ZydisDecodedInstruction& insn, const ZydisDecodedOperand& op, std::uint64_t value) noexcept
+{
+	switch (op.type)
+	{
+	case ZYDIS_OPERAND_TYPE_REGISTER:
+	{
+		std::uint64_t* pReg = _register(op.reg.value);
+		if (pReg == nullptr)
+			return false;
+
+		//
+		// 32bit writes clear the upper half, 8 and 16bit writes leave the rest of the register alone.
+		if (op.size >= 32)
+			*pReg = value & WidthMask(op.size);
+		else
+			*pReg = (*pReg & ~WidthMask(op.size)) | (value & WidthMask(op.size));
+
+		return true;
+	}
+	case ZYDIS_OPERAND_TYPE_MEMORY:
+	{
+		std::uint64_t address;
+
+		return op.mem.type == ZYDIS_MEMOP_TYPE_MEM && op.size >= 8 && op.size <= 64 && _address(insn, op, address) && _write(address, &value, op.size / 8);
+	}
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <type_traits>
+#include <Zydis/Zydis.h>
+#include "VIFGuestMemory.hpp"
+
+///
+//! class VifMicroEmulator
+//! Interprets the handful of instructions import stubs are made of (mov, lea, add, sub, xor, xchg, push, pop,
+//! jmp, ret and a few more) straight from the shared image bytes, with a private copy of the stack. It gives up
+//! on anything else, the engine then runs the stub through Unicorn instead.
+///
+template<size_t BitSize>
+class VifMicroEmulator : pepp::msc::NonCopyable
+{
+public:
+	using AddressType = std::conditional_t<BitSize == 64, std::uint64_t, std::uint32_t>;
+
+	//! Stubs that run longer than this are left to Unicorn.
+	static constexpr std::uint64_t MAX_INSTRUCTIONS = 1024;
+
+	//! The decoder is borrowed from the engine.
+	VifMicroEmulator(const ZydisDecoder* decoder) noexcept;
+
+	//! Memory is read exactly as the engine maps it: from `regions` (mapped up front) and `lazy`.
+	//! The stack is [stack_base, stack_base + stack_size), stubs start with `stack_pointer` in RSP/ESP.
+	void Initialize(const std::vector<VifMemoryRegion_t>* regions, const VifLazyMemoryMap* lazy,
+		std::uint64_t stack_base, std::uint64_t stack_size, std::uint64_t stack_pointer);
+
+	//! Run a stub as if it was just called, until it leaves its image.
+	//! - returns false as soon as the stub does anything that isn't supported, `exit_address` is meaningless then.
+	bool Run(const VifStubJob_t& job, std::uint64_t max_instructions, std::uint64_t& exit_address) noexcept;
+
+	//! Instructions the last stub ran
+	std::uint64_t GetLastInstructions() const noexcept {
+		return m_instructions;
+	}
+
+private:
+	static constexpr std::uint64_t ADDRESS_MASK = BitSize == 64 ? ~0ull : 0xffffffffull;
+	static constexpr std::uint64_t GUEST_PAGE_SIZE = 0x1000;
+
+	//! Read guest memory, false if any of it isn't mapped.
+	bool _read(std::uint64_t address, void* buffer, std::size_t size) const noexcept;
+
+	//! Write guest memory, only the stack is writable.
+	bool _write(std::uint64_t address, const void* buffer, std::size_t size) noexcept;
+
+	bool _push(std::uint64_t value, std::size_t size) noexcept;
+	bool _pop(std::uint64_t& value, std::size_t size) noexcept;
+
+	//! The general purpose register holding `reg`, nullptr for anything else (including AH-DH).
+	std::uint64_t* _register(ZydisRegister reg) noexcept;
+
+	//! Effective address of a memory operand
+	bool _address(const ZydisDecodedInstruction& insn, const ZydisDecodedOperand& op, std::uint64_t& address) noexcept;
+
+	//! Read or write an explicit operand, values are truncated to the operand size on write.
+	bool _get(const ZydisDecodedInstruction& insn, const ZydisDecodedOperand& op, std::uint64_t& value) noexcept;
+	bool _set(const ZydisDecodedInstruction& insn, const ZydisDecodedOperand& op, std::uint64_t value) noexcept;
+
+	//! Execute a single instruction, anything unsupported returns false.
+	bool _step(const ZydisDecodedInstruction& insn) noexcept;
+
+	const ZydisDecoder*						m_decoder;
+	const std::vector<VifMemoryRegion_t>*	m_regions = nullptr;
+	const VifLazyMemoryMap*					m_lazy = nullptr;
+	std::uint64_t							m_stackBase = 0;
+	std::uint64_t							m_stackPointer = 0;
+	//! Private copy of the stack, only what the last stub wrote is cleared again.
+	std::vector<std::uint8_t>				m_stack;
+	std::size_t								m_dirtyBegin = 0;
+	std::size_t								m_dirtyEnd = 0;
+	std::array<std::uint64_t, 16>			m_gpr{};
+	std::uint64_t							m_rip = 0;
+	std::uint64_t							m_instructions = 0;
+};
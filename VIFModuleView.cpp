@@ -0,0 +1,283 @@
+#include "VMPImportFixer.hpp"
+
+// Explicit templates.
+template class VifModuleView<32>;
+template class VifModuleView<64>;
+
+template<size_t BitSize>
+VifModuleView<BitSize>::VifModuleView(const VIFModuleInformation_t& info, std::shared_ptr<const vif::IMemorySource> source, const std::uint8_t* data) noexcept
+	: m_info(info)
+	, m_source(std::move(source))
+	, m_data(data)
+{
+}
+
+template<size_t BitSize>
+bool VifModuleView<BitSize>::_read(std::uint64_t offset, void* buffer, std::size_t size, std::size_t workers) const
+{
+	if (offset > m_info.module_size || size > m_info.module_size - offset)
+		return false;
+
+	std::size_t nRead = m_source->Read(m_info.base_address + offset, buffer, size, workers);
+
+	m_bytesRead.fetch_add(nRead, std::memory_order_relaxed);
+	return nRead == size;
+}
+
+template<size_t BitSize>
+pepp::Image<BitSize>* VifModuleView<BitSize>::LoadImage()
+{
+	if (!m_image)
+	{
+		if (auto image = _buildImage())
+		{
+			m_image.emplace(std::move(*image));
+
+			//
+			// Lookups can go through the image as soon as it is there, so it is indexed before anyone gets to it.
+			m_image->GetExportDirectory().BuildIndex();
+		}
+	}
+
+	return m_image ? &*m_image : nullptr;
+}
+
+template<size_t BitSize>
+std::optional<pepp::Image<BitSize>> VifModuleView<BitSize>::CopyImage() const
+{
+	return _buildImage();
+}
+
+template<size_t BitSize>
+std::optional<pepp::Image<BitSize>> VifModuleView<BitSize>::_buildImage() const
+{
+	pepp::mem::ByteVector buffer{};
+	buffer.resize(m_info.module_size);
+
+	//
+	// CopyImage() is only used while the loaded image is kept unpatched, so it is as good a source as the original bytes.
+	if (const std::uint8_t* pData = GetData())
+		std::memcpy(buffer.data(), pData, m_info.module_size);
+	else if (!_read(0, buffer.data(), buffer.size(), 0))
+		logger->warn("Parts of {} could not be read, they are left zeroed", m_info.module_path);
+
+	auto* pDosHdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(buffer.data());
+
+	if (buffer.size() < pepp::PAGE_SIZE || pDosHdr->e_magic != IMAGE_DOS_SIGNATURE)
+		return std::nullopt;
+
+	return pepp::Image<BitSize>::FromRuntimeMemory(std::move(buffer));
+}
+
+template<size_t BitSize>
+const std::uint8_t* VifModuleView<BitSize>::GetData() const noexcept
+{
+	if (m_image)
+		return &m_image->buffer()[0];
+
+	return m_data;
+}
+
+template<size_t BitSize>
+const std::uint8_t* VifModuleView<BitSize>::GetPage(std::uint64_t offset) const
+{
+	if (const std::uint8_t* pData = GetData())
+		return offset < m_info.module_size ? pData + offset : nullptr;
+
+	std::uint64_t page = offset & ~(std::uint64_t)(pepp::PAGE_SIZE - 1);
+
+	if (page + pepp::PAGE_SIZE > m_info.module_size)
+		return nullptr;
+
+	std::lock_guard lock(m_pageLock);
+
+	auto& pPage = m_pages[page];
+
+	if (!pPage)
+	{
+		pPage = std::make_unique<std::uint8_t[]>(pepp::PAGE_SIZE);
+		_read(page, pPage.get(), pepp::PAGE_SIZE);
+	}
+
+	return pPage.get() + (offset - page);
+}
+
+template<size_t BitSize>
+auto VifModuleView<BitSize>::_ntHeaders(const std::uint8_t* page) noexcept -> const Header_t*
+{
+	auto* pDosHdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(page);
+
+	if (pDosHdr->e_magic != IMAGE_DOS_SIGNATURE || pDosHdr->e_lfanew <= 0 ||
+		static_cast<std::size_t>(pDosHdr->e_lfanew) + sizeof(Header_t) > pepp::PAGE_SIZE)
+		return nullptr;
+
+	auto* pNtHdr = reinterpret_cast<const Header_t*>(page + pDosHdr->e_lfanew);
+
+	//
+	// WoW64 processes carry 64bit modules as well, those can't be parsed (or imported from).
+	if (pNtHdr->Signature != IMAGE_NT_SIGNATURE ||
+		pNtHdr->OptionalHeader.Magic != (BitSize == 32 ? IMAGE_NT_OPTIONAL_HDR32_MAGIC : IMAGE_NT_OPTIONAL_HDR64_MAGIC))
+		return nullptr;
+
+	return pNtHdr;
+}
+
+template<size_t BitSize>
+std::vector<IMAGE_SECTION_HEADER> VifModuleView<BitSize>::GetSectionHeaders() const
+{
+	std::vector<IMAGE_SECTION_HEADER> vecSections;
+	const std::uint8_t* pHeaders = GetPage(0);
+	const Header_t* pNtHdr = pHeaders ? _ntHeaders(pHeaders) : nullptr;
+
+	if (pNtHdr == nullptr)
+		return vecSections;
+
+	auto* pFirst = IMAGE_FIRST_SECTION(pNtHdr);
+	std::size_t nMaxSections = (pepp::PAGE_SIZE - (reinterpret_cast<const std::uint8_t*>(pFirst) - pHeaders)) / sizeof(IMAGE_SECTION_HEADER);
+
+	vecSections.assign(pFirst, pFirst + std::min<std::size_t>(pNtHdr->FileHeader.NumberOfSections, nMaxSections));
+	return vecSections;
+}
+
+template<size_t BitSize>
+void VifModuleView<BitSize>::_loadExports()
+{
+	std::vector<std::uint8_t> vecHeaders(pepp::PAGE_SIZE);
+
+	if (!_read(0, vecHeaders.data(), vecHeaders.size()) || _ntHeaders(vecHeaders.data()) == nullptr)
+		return;
+
+	auto* pDosHdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(vecHeaders.data());
+	auto* pNtHdr = reinterpret_cast<Header_t*>(vecHeaders.data() + pDosHdr->e_lfanew);
+
+	//
+	// The headers have to fit in the first page, with room for the one section header we write.
+	std::size_t uSectionTable = reinterpret_cast<std::uint8_t*>(IMAGE_FIRST_SECTION(pNtHdr)) - vecHeaders.data();
+
+	if (uSectionTable + sizeof(IMAGE_SECTION_HEADER) > vecHeaders.size())
+		return;
+
+	IMAGE_DATA_DIRECTORY dirExport = pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+	IMAGE_EXPORT_DIRECTORY exportDir{};
+
+	if (dirExport.VirtualAddress == 0 || !_read(dirExport.VirtualAddress, &exportDir, sizeof(exportDir)))
+		return;
+
+	//
+	// The tables and names normally all live inside of the directory, but nothing forces them to.
+	// Read the range covering the directory and every table, and widen it once more if a name lies outside.
+	std::uint64_t uBegin = dirExport.VirtualAddress;
+	std::uint64_t uEnd = static_cast<std::uint64_t>(dirExport.VirtualAddress) + std::max<std::uint64_t>(dirExport.Size, sizeof(exportDir));
+
+	auto Widen = [&](std::uint64_t rva, std::uint64_t size)
+	{
+		if (rva == 0)
+			return;
+
+		uBegin = std::min(uBegin, rva);
+		uEnd = std::max(uEnd, rva + size);
+	};
+
+	Widen(exportDir.AddressOfFunctions, exportDir.NumberOfFunctions * sizeof(std::uint32_t));
+	Widen(exportDir.AddressOfNames, exportDir.NumberOfNames * sizeof(std::uint32_t));
+	Widen(exportDir.AddressOfNameOrdinals, exportDir.NumberOfNames * sizeof(std::uint16_t));
+
+	std::vector<std::uint8_t> vecExports{};
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		uEnd = std::min<std::uint64_t>(uEnd, m_info.module_size);
+
+		if (uBegin >= uEnd)
+			return;
+
+		vecExports.assign(static_cast<std::size_t>(uEnd - uBegin), 0);
+		_read(uBegin, vecExports.data(), vecExports.size());
+
+		std::uint64_t uNames = exportDir.AddressOfNames - uBegin;
+		std::uint64_t uEndBefore = uEnd;
+
+		if (exportDir.AddressOfNames == 0 || uNames + exportDir.NumberOfNames * sizeof(std::uint32_t) > vecExports.size())
+			break;
+
+		for (std::uint32_t i = 0; i < exportDir.NumberOfNames; ++i)
+		{
+			std::uint32_t uNameRva;
+			std::memcpy(&uNameRva, &vecExports[uNames + i * sizeof(std::uint32_t)], sizeof(uNameRva));
+
+			//
+			// No way of telling how long a name is without reading it, assume they're sane.
+			Widen(uNameRva, 0x100);
+		}
+
+		if (uEnd == uEndBefore)
+			break;
+	}
+
+	//
+	// Lay it out as a single section right behind the headers, nothing else of the module is kept.
+	std::vector<std::uint8_t> buffer(pepp::PAGE_SIZE + vecExports.size());
+	std::memcpy(buffer.data(), vecHeaders.data(), vecHeaders.size());
+	std::memcpy(buffer.data() + pepp::PAGE_SIZE, vecExports.data(), vecExports.size());
+
+	pNtHdr = reinterpret_cast<Header_t*>(buffer.data() + pDosHdr->e_lfanew);
+	pNtHdr->FileHeader.NumberOfSections = 1;
+
+	for (std::uint32_t i = 0; i < IMAGE_NUMBEROF_DIRECTORY_ENTRIES; ++i)
+	{
+		if (i != IMAGE_DIRECTORY_ENTRY_EXPORT)
+			pNtHdr->OptionalHeader.DataDirectory[i] = {};
+	}
+
+	IMAGE_SECTION_HEADER secExports{};
+	std::memcpy(secExports.Name, ".edata", sizeof(".edata") - 1);
+	secExports.Misc.VirtualSize = static_cast<std::uint32_t>(vecExports.size());
+	secExports.VirtualAddress = static_cast<std::uint32_t>(uBegin);
+	secExports.SizeOfRawData = static_cast<std::uint32_t>(vecExports.size());
+	secExports.PointerToRawData = pepp::PAGE_SIZE;
+	std::memcpy(buffer.data() + uSectionTable, &secExports, sizeof(secExports));
+
+	m_exports.emplace(buffer.data(), buffer.size());
+	m_exports->GetExportDirectory().BuildIndex();
+}
+
+template<size_t BitSize>
+pepp::ExportDirectory<BitSize>* VifModuleView<BitSize>::_exports()
+{
+	//
+	// A loaded image is indexed already, the compact one only has to be built without it.
+	std::call_once(m_exportsOnce, [this]
+		{
+			if (!m_image)
+				_loadExports();
+		});
+
+	//
+	// Exports read before the image was loaded (e.g by an earlier job on a warm snapshot) keep being used,
+	// lookups only ever read an index that is already built.
+	if (m_exports)
+		return &m_exports->GetExportDirectory();
+
+	return m_image ? &m_image->GetExportDirectory() : nullptr;
+}
+
+template<size_t BitSize>
+bool VifModuleView<BitSize>::FindExportByRva(std::uint32_t rva, pepp::ExportData_t* exp, bool demangle)
+{
+	pepp::ExportDirectory<BitSize>* pExports = _exports();
+	return pExports ? pExports->FindExportByRva(rva, exp, demangle) : false;
+}
+
+template<size_t BitSize>
+bool VifModuleView<BitSize>::FindExportByName(std::string_view name, pepp::ExportData_t* exp, bool demangle)
+{
+	pepp::ExportDirectory<BitSize>* pExports = _exports();
+	return pExports ? pExports->FindExportByName(name, exp, demangle) : false;
+}
+
+template<size_t BitSize>
+bool VifModuleView<BitSize>::FindExportByOrdinal(std::uint32_t ordinal, pepp::ExportData_t* exp, bool demangle)
+{
+	pepp::ExportDirectory<BitSize>* pExports = _exports();
+	return pExports ? pExports->FindExportByOrdinal(ordinal, exp, demangle) : false;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+///
+//! class VifModuleView
+//! A module of the target, only read as far as it is actually used.
+//! Export lookups only ever read the headers and the export directory, a full image is only built on request.
+///
+template<size_t BitSize>
+class VifModuleView : pepp::msc::NonCopyable
+{
+public:
+	using Header_t = typename pepp::detail::Image_t<BitSize>::Header_t;
+
+	//! `data` is optional, if the whole module is already in memory it is used directly instead of the source.
+	VifModuleView(const VIFModuleInformation_t& info, std::shared_ptr<const vif::IMemorySource> source, const std::uint8_t* data = nullptr) noexcept;
+
+	//! Read the whole module and build a full image of it, meant for the module being fixed.
+	//! - returns nullptr if it isn't a valid image.
+	pepp::Image<BitSize>* LoadImage();
+
+	//! A separate full image, built from the same bytes LoadImage() was. Patching it leaves the loaded one untouched.
+	//! - returns nullopt if it isn't a valid image.
+	std::optional<pepp::Image<BitSize>> CopyImage() const;
+
+	//! The full image, if LoadImage() was called
+	pepp::Image<BitSize>* GetImage() noexcept {
+		return m_image ? &*m_image : nullptr;
+	}
+
+	//! Look up an export by rva, the export directory is read the first time.
+	//! - Safe to call from several threads at once.
+	//! - Names are matched raw, `demangle` only applies to the name handed back.
+	bool FindExportByRva(std::uint32_t rva, pepp::ExportData_t* exp, bool demangle = true);
+	bool FindExportByName(std::string_view name, pepp::ExportData_t* exp, bool demangle = true);
+	bool FindExportByOrdinal(std::uint32_t ordinal, pepp::ExportData_t* exp, bool demangle = true);
+
+	//! A single page of the module, read and cached on first use.
+	//! - Safe to call from several threads at once, the page stays valid as long as the view.
+	const std::uint8_t* GetPage(std::uint64_t offset) const;
+
+	//! The section table, off of the first page only
+	//! - empty if the headers aren't valid (or of the other bitsize).
+	std::vector<IMAGE_SECTION_HEADER> GetSectionHeaders() const;
+
+	//! The whole module, if it is in memory already (the full image or `data`)
+	const std::uint8_t* GetData() const noexcept;
+
+	const VIFModuleInformation_t& GetInformation() const noexcept {
+		return m_info;
+	}
+
+	//! Bytes read from the source so far
+	std::size_t GetBytesRead() const noexcept {
+		return m_bytesRead.load(std::memory_order_relaxed);
+	}
+
+private:
+	//! NT headers inside of the first page of a module, nullptr if they aren't valid for this bitsize.
+	static const Header_t* _ntHeaders(const std::uint8_t* page) noexcept;
+
+	//! Build a full image out of the module's bytes
+	std::optional<pepp::Image<BitSize>> _buildImage() const;
+
+	//! Read into `buffer`, counting the bytes.
+	bool _read(std::uint64_t offset, void* buffer, std::size_t size, std::size_t workers = 1) const;
+
+	//! Build the compact export image, only ever done once.
+	void _loadExports();
+
+	//! The export directory lookups go through, nullptr if the module has none.
+	pepp::ExportDirectory<BitSize>* _exports();
+
+	VIFModuleInformation_t										m_info;
+	std::shared_ptr<const vif::IMemorySource>					m_source;
+	const std::uint8_t*											m_data;
+	std::optional<pepp::Image<BitSize>>							m_image;
+	//! Headers and the export directory only, built the first time an export is looked up.
+	std::once_flag												m_exportsOnce;
+	std::optional<pepp::Image<BitSize>>							m_exports;
+	mutable std::mutex											m_pageLock;
+	mutable std::unordered_map<std::uint64_t, std::unique_ptr<std::uint8_t[]>> m_pages;
+	mutable std::atomic<std::size_t>							m_bytesRead{ 0 };
+};
@@ -83,3 +83,19 @@ bool VifFindModulesInProcess(HANDLE hProc, std::vector<VIFModuleInformation_t>&
 
     return modules.size() > 0;
 }
+
+bool VifReadModule(const vif::IMemorySource& source, const VIFModuleInformation_t& mod, std::uint8_t* buffer)
+{
+    //
+    // One read per readable range of the module, spread across threads. Whatever can't be read is zeroed.
+    std::size_t nRead = source.Read(mod.base_address, buffer, mod.module_size, 0);
+
+    if (nRead != mod.module_size)
+    {
+        // Log the faliure, but that is all. We will still try to parse.
+        logger->critical("Unable to read {} of {} bytes of {}", mod.module_size - nRead, mod.module_size, mod.module_path);
+        return false;
+    }
+
+    return true;
+}
@@ -5,10 +5,13 @@ struct VIFModuleInformation_t
     std::string module_path;
     std::uint64_t base_address;
     std::uint32_t module_size;
+    //! File name part of module_path, filled in once the module list is complete.
+    std::string module_name{};
 };
 
 
 DWORD VifSearchForProcess(std::string_view process_name) noexcept;
 bool VifFindModuleInProcess(HANDLE hProc, std::string_view module_name, VIFModuleInformation_t* info);
 bool VifFindModulesInProcess(HANDLE hProc, std::vector<VIFModuleInformation_t>& modules);
+bool VifReadModule(const vif::IMemorySource& source, const VIFModuleInformation_t& mod, std::uint8_t* buffer);
 
@@ -8,355 +8,886 @@ std::shared_ptr<spdlog::logger> logger;
 template class VMPImportFixer<32>;
 template class VMPImportFixer<64>;
 
-class UnicornEngine
+template<size_t BitSize>
+inline bool VMPImportFixer<BitSize>::DumpInMemory(HANDLE hProcess, std::string_view sModName)
 {
-	uc_engine* ptr;
-public:
-	UnicornEngine(uc_engine* eng) noexcept
-		: ptr(eng)
-	{}
+	vif::nt::Process proc(hProcess);
+	spdlog::stopwatch sw;
 
-	~UnicornEngine() noexcept
+	if (proc.handle() == INVALID_HANDLE_VALUE)
 	{
-		if (ptr)
-			uc_close(ptr);
+		return false;
 	}
-};
 
+	m_stats = {};
+	m_metrics.Clear();
 
-template<size_t BitSize>
-inline void VMPImportFixer<BitSize>::DumpInMemory(HANDLE hProcess, std::string_view sModName)
-{
-	//
-	// Define types for the current mode.
-	using AddressType = pepp::detail::Image_t<BitSize>::Address_t;
-	using Address = pepp::Address<AddressType>;
+	bool bFound = false;
+	{
+		VifScopedPhase phase(m_metrics, "modules");
+		bFound = VifFindModulesInProcess(hProcess, m_vecModuleList);
+	}
 
-	static constexpr uc_mode EMULATION_MODE = BitSize == 32 ? UC_MODE_32 : UC_MODE_64;
-	static constexpr uc_x86_reg STACK_REGISTER = BitSize == 32 ? UC_X86_REG_ESP : UC_X86_REG_RSP;
-	static ZydisMachineMode ZY_MACHINE_MODE = BitSize == 32 ? ZYDIS_MACHINE_MODE_LONG_COMPAT_32 : ZYDIS_MACHINE_MODE_LONG_64;
-	static ZydisAddressWidth ZY_ADDRESS_WIDTH = BitSize == 32 ? ZYDIS_ADDRESS_WIDTH_32 : ZYDIS_ADDRESS_WIDTH_64;
+	if (!bFound || m_vecModuleList.empty())
+	{
+		logger->critical("Unable to fetch module list from process.");
+		return false;
+	}
 
 	//
-	// Initialize unicorn.
-	uc_engine* uc{};
-	uc_hook code_hook{};
-	uc_err err = uc_open(UC_ARCH_X86, EMULATION_MODE, &uc);
-	UnicornEngine _scoped_unicorn_free(uc);
+	// Nothing is read yet, modules are read as far as they're used once the target is known.
+	auto pSource = std::make_shared<vif::ProcessMemorySource>(hProcess);
 
-	if (err != UC_ERR_OK)
+	for (auto& mod : m_vecModuleList)
 	{
-		logger->critical("Unable to open Unicorn in X86-{} mode (err: {})", BitSize, err);
-		return;
+		logger->debug("Pushing module {} located @ 0x{:X}", mod.module_path, mod.base_address);
+
+		m_vecModuleViews.push_back(std::make_unique<VifModuleView<BitSize>>(mod, pSource));
 	}
 
-	if (ZyanStatus zs; !ZYAN_SUCCESS((zs = ZydisDecoderInit(&m_decoder, ZY_MACHINE_MODE, ZY_ADDRESS_WIDTH))))
+	IndexModules();
+
+	bool bFixed = FixImports(sModName);
+	WriteMetrics(std::chrono::duration<double>(sw.elapsed()).count());
+	return bFixed;
+}
+
+template<size_t BitSize>
+inline bool VMPImportFixer<BitSize>::DumpFromSnapshot(const vif::Snapshot& snapshot, std::string_view sModName)
+{
+	spdlog::stopwatch sw;
+
+	if (snapshot.GetModuleCount() == 0)
 	{
-		logger->critical("Unable to initialize Zydis (err: {:X})", BitSize, zs);
-		return;
+		logger->critical("Snapshot contains no modules.");
+		return false;
 	}
 
-	vif::nt::Process proc(hProcess);
-	pepp::Image<BitSize>* pTargetImg = nullptr;
-	
+	m_stats = {};
+	m_metrics.Clear();
 
-	if (proc.handle() == INVALID_HANDLE_VALUE)
+	//
+	// A warm fixer already has the modules, along with every export directory read so far.
+	if (m_vecModuleViews.empty())
 	{
-		return;
+		auto pSource = std::make_shared<vif::BufferMemorySource>();
+
+		for (std::uint32_t i = 0; i < snapshot.GetModuleCount(); ++i)
+		{
+			m_vecModuleList.emplace_back(snapshot.GetModuleInformation(i));
+
+			auto& mod = m_vecModuleList.back();
+
+			logger->debug("Pushing module {} located @ 0x{:X}", mod.module_path, mod.base_address);
+
+			//
+			// Views read straight off of the mapped view, no intermediate buffer or process reads.
+			const std::uint8_t* pData = snapshot.GetModuleData(i);
+
+			pSource->AddRange(mod.base_address, pData, mod.module_size);
+
+			m_vecModuleViews.push_back(std::make_unique<VifModuleView<BitSize>>(mod, pSource, pData));
+		}
+
+		IndexModules();
 	}
 
+	bool bFixed = FixImports(sModName);
+	WriteMetrics(std::chrono::duration<double>(sw.elapsed()).count());
+	return bFixed;
+}
+
+template<size_t BitSize>
+bool VMPImportFixer<BitSize>::IsVmpSectionName(std::string_view name) const noexcept
+{
+	if (m_options.section_names.empty())
+		return name == ".vmp0";
+
+	return std::find(m_options.section_names.begin(), m_options.section_names.end(), name) != m_options.section_names.end();
+}
 
-	if (!VifFindModulesInProcess(hProcess, m_vecModuleList) || m_vecModuleList.empty())
+template<size_t BitSize>
+bool VMPImportFixer<BitSize>::HasVmpSection(std::size_t idx) const
+{
+	for (auto& sec : m_vecModuleViews[idx]->GetSectionHeaders())
 	{
-		logger->critical("Unable to fetch module list from process.");
-		return;
+		std::string_view sName(reinterpret_cast<const char*>(sec.Name), strnlen(reinterpret_cast<const char*>(sec.Name), IMAGE_SIZEOF_SHORT_NAME));
+
+		if (IsVmpSectionName(sName) || sName.starts_with(".vmp"))
+			return true;
 	}
 
-	int Idx{}, mIdx{};
+	return false;
+}
 
-	for (auto& mod : m_vecModuleList)
+template<size_t BitSize>
+std::vector<pepp::SectionHeader*> VMPImportFixer<BitSize>::FindVmpSections(pepp::Image<BitSize>& img) const
+{
+	std::vector<pepp::SectionHeader*> vecSections;
+
+	for (std::uint16_t i = 0; i < img.GetNumberOfSections(); ++i)
 	{
-		size_t nLastSize = 0;
-		std::unique_ptr<std::uint8_t> pModBuffer(new std::uint8_t[mod.module_size]{});
-		MEMORY_BASIC_INFORMATION mbi{};
+		if (IsVmpSectionName(img.GetSectionHeader(i).GetName()))
+			vecSections.push_back(&img.GetSectionHeader(i));
+	}
 
-		//
-		// Loop through the module's memory and insert into the buffer.
-		while (VirtualQueryEx(proc.handle(), (PVOID)(mod.base_address + nLastSize), &mbi, sizeof (mbi)))
+	//
+	// Modules found by the heuristic don't necessarily use the configured names.
+	if (vecSections.empty() && m_options.fix_all)
+	{
+		for (std::uint16_t i = 0; i < img.GetNumberOfSections(); ++i)
 		{
-			if (proc.ReadMemory(mbi.BaseAddress, &pModBuffer.get()[nLastSize], mbi.RegionSize))
-				; // logger->info("Read memory at {} with size {}", mbi.BaseAddress, mbi.RegionSize);
-			else
-				// Log the faliure, but that is all. We will still try to parse.
-				logger->critical("Unable to read memory at {:X}", (std::uintptr_t)mbi.BaseAddress);
+			if (img.GetSectionHeader(i).GetName().starts_with(".vmp"))
+				vecSections.push_back(&img.GetSectionHeader(i));
+		}
+	}
 
-			nLastSize += mbi.RegionSize;
+	return vecSections;
+}
 
-			if (nLastSize >= mod.module_size)
-				break;
-		}
+template<size_t BitSize>
+bool VMPImportFixer<BitSize>::PrepareTarget(VifTarget_t& target)
+{
+	using AddressType = pepp::detail::Image_t<BitSize>::Address_t;
 
-		logger->info("Pushing module {} located @ 0x{:X}", mod.module_path, mod.base_address);
+	//
+	// Targets are the only modules read in full, they are the ones being patched.
+	{
+		VifScopedPhase phase(m_metrics, "load");
+		target.image = m_vecModuleViews[target.index]->LoadImage();
+	}
 
-		m_vecImageList.emplace_back(std::move(pepp::Image<BitSize>::FromRuntimeMemory(pModBuffer.get(), mod.module_size)));
+	if (target.image == nullptr)
+	{
+		logger->critical("Failed parsing image: {}", m_vecModuleList[target.index].module_path);
+		return false;
+	}
 
-		if (m_vecImageList.back().magic() != IMAGE_DOS_SIGNATURE)
-		{
-			logger->error("Failed parsing image: {}", mod.module_path);
-			continue;
-		}
+	pepp::Image<BitSize>* pTargetImg = target.image;
+	target.image_base = pTargetImg->GetPEHeader().GetOptionalHeader().GetImageBase();
+
+	logger->info("[{}] Using base address: {:X}", target.name, target.image_base);
 
-		if (!sModName.empty() && mod.module_path.find(sModName) != std::string::npos)
-			mIdx = Idx;
+	//
+	// Every VMP section is a possible call destination.
+	std::vector<pepp::SectionHeader*> vecVmpSections = FindVmpSections(*pTargetImg);
 
-		++Idx;
+	if (vecVmpSections.empty())
+	{
+		logger->critical("[{}] Unable to find a VMP section!", target.name);
+		return false;
 	}
 
-	for (auto &img : m_vecImageList)
+	//
+	// Code is found by the section characteristics rather than by name, targets keep code in .text, INIT or
+	// anything else. VMP's own sections are left out.
+	std::vector<pepp::SectionHeader*> vecCodeSections;
+
+	for (std::uint16_t i = 0; i < pTargetImg->GetNumberOfSections(); ++i)
 	{
-		if (!sModName.empty())
-			pTargetImg = &m_vecImageList[mIdx];
+		pepp::SectionHeader& sec = pTargetImg->GetSectionHeader(i);
+
+		if (sec.IsExecutable() && !sec.GetName().starts_with(".vmp") &&
+			std::find(vecVmpSections.begin(), vecVmpSections.end(), &sec) == vecVmpSections.end())
+			vecCodeSections.push_back(&sec);
+	}
 
-		m_ImageMap[img.GetPEHeader().GetOptionalHeader().GetImageBase()] = &img;
+	if (vecCodeSections.empty())
+	{
+		logger->critical("[{}] Unable to find an executable section!", target.name);
+		return false;
 	}
 
+	for (pepp::SectionHeader* sec : vecCodeSections)
+		logger->info("[{}] Found code section {} at virtual address {:X}", target.name, sec->GetName(), sec->GetVirtualAddress());
+
+	for (pepp::SectionHeader* sec : vecVmpSections)
+		logger->info("[{}] Found {} section at virtual address {:X}", target.name, sec->GetName(), sec->GetVirtualAddress());
+
+	if (!m_options.cache_path.empty())
+		HashTarget(target, vecVmpSections);
+
 	//
-	// If no target module is selected, we default to the base process.
-	if (pTargetImg == nullptr)
-		pTargetImg = &m_vecImageList.front();
+	// Find all calls from the code sections into the VMP sections. The rel32 is enough to tell where a call
+	// leads, so nothing is decoded and only calls into a VMP section are ever stored.
+	VifCallScanRange_t scanRange{};
+	scanRange.image = pTargetImg->buffer().data();
+	scanRange.image_size = pTargetImg->buffer().size();
+	scanRange.image_base = target.image_base;
 
+	for (pepp::SectionHeader* sec : vecCodeSections)
+		scanRange.code.push_back({ sec->GetPointerToRawData(), sec->GetPointerToRawData() + sec->GetSizeOfRawData() });
 
-	Address uImageBase = pTargetImg->GetPEHeader().GetOptionalHeader().GetImageBase();
+	for (pepp::SectionHeader* sec : vecVmpSections)
+		scanRange.targets.push_back({ sec->GetVirtualAddress(), sec->GetVirtualAddress() + sec->GetVirtualSize() });
 
-	logger->info("Using base address: {:X}", uImageBase.uintptr());
+	spdlog::stopwatch swScan;
 
 	//
-	// By default, we scan the .text section by name. If the target binary for whatever reason
-	// has another name other than .text for it's code section, you will need to change this.
-	pepp::SectionHeader& secText = pTargetImg->GetSectionHeader(".text");
-	
-	if (secText.GetName() == ".dummy")
+	// Locations of vmp import calls
+	target.calls = VifFindImportCalls(scanRange, m_options.workers);
+
+	double dScanTime = std::chrono::duration<double>(swScan.elapsed()).count();
+
+	m_metrics.AddPhase("scan", dScanTime);
+
+	if (target.calls.empty())
 	{
-		logger->critical("Unable to find .text section!");
-		return;
+		logger->critical("[{}] Unable to find any calls into the VMP sections!", target.name);
+		return false;
 	}
 
-	logger->info("Found .text section at virtual address {:X}", secText.GetVirtualAddress());
+	logger->info("[{}] Found {} calls into {} VMP sections across {} code sections in {:.3f}s", target.name, target.calls.size(),
+		vecVmpSections.size(), vecCodeSections.size(), dScanTime);
 
-	pepp::SectionHeader& secVMP = pTargetImg->GetSectionHeader(m_strVMPSectionName);
-	if (secVMP.GetName() == ".dummy")
+	auto SectionName = [pTargetImg](std::uint64_t rva) { return pTargetImg->GetSectionHeaderFromVa(static_cast<std::uint32_t>(rva)).GetName(); };
+
+	//
+	// One line per call site, don't even look the sections up unless they're going to be logged.
+	if (logger->should_log(spdlog::level::debug))
 	{
-		logger->critical("Unable to find {} section!", secVMP.GetName());
-		return;
+		for (auto& call : target.calls)
+		{
+			logger->debug("Found call to {} in {} @ {:X} (call to {:X})",
+				SectionName(call.destination - target.image_base),
+				SectionName(call.offset),
+				(AddressType)(target.image_base + call.offset),
+				call.destination);
+		}
 	}
 
-	logger->info("Found {} section at virtual address {:X}", m_strVMPSectionName, secVMP.GetVirtualAddress());
+	//
+	// Map the code and VMP sections into every engine. The image buffer is mapped directly and shared,
+	// engines never write to it.
+	auto PageCeil = [](std::uint64_t size) { return (size + pepp::PAGE_SIZE - 1) & ~(std::uint64_t)(pepp::PAGE_SIZE - 1); };
+
+	for (auto* vecSections : { &vecCodeSections, &vecVmpSections })
+	{
+		for (pepp::SectionHeader* sec : *vecSections)
+		{
+			std::uint64_t uMappedSize = PageCeil(sec->GetVirtualSize());
+
+			if (sec->GetVirtualAddress() + uMappedSize > pTargetImg->buffer().size())
+			{
+				logger->critical("[{}] Section {} lies outside of the image buffer!", target.name, sec->GetName());
+				return false;
+			}
+
+			target.regions.push_back({ target.image_base + sec->GetVirtualAddress(), uMappedSize, &pTargetImg->buffer()[sec->GetVirtualAddress()] });
+		}
+	}
 
 	//
-	// Find all call sequences in the .text section.
-	std::vector<uint32_t> vecCallMatches = 
-		pTargetImg->FindBinarySequence(&secText, "E8 ? ? ? ?");
+	// Many call sites share a stub. A stub only behaves differently depending on the call variant
+	// (the return address adjustment), so each (stub, variant) pair is emulated once, using its first call site.
+	std::map<std::pair<std::uint64_t, VifCallVariant>, std::size_t> mStubIndex;
+
+	target.stub_of_call.resize(target.calls.size());
 
-	if (vecCallMatches.empty())
+	for (std::size_t i = 0; i < target.calls.size(); ++i)
 	{
-		logger->critical("Unable to find any call/jmp sequences in the .text section!");
-		return;
+		auto [it, inserted] = mStubIndex.try_emplace(
+			{ target.calls[i].destination, target.calls[i].variant }, target.stubs.size());
+
+		if (inserted)
+			target.stubs.push_back(target.calls[i]);
+
+		target.stub_of_call[i] = it->second;
 	}
 
+	return true;
+}
+
+template<size_t BitSize>
+void VMPImportFixer<BitSize>::HashTarget(VifTarget_t& target, const std::vector<pepp::SectionHeader*>& vmp_sections) const
+{
+	using Header_t = typename pepp::detail::Image_t<BitSize>::Header_t;
+	using AddressType = typename pepp::detail::Image_t<BitSize>::Address_t;
+
+	const pepp::mem::ByteVector& buffer = target.image->buffer();
+
 	//
-    // Map the .text and .vmp0 sections into the emulator memory (even more overhead, but necessary)
-	Address uMappedTextAddress = (uImageBase + secText.GetVirtualAddress());
-	Address uMappedTextSize = pepp::Align4kb(secText.GetVirtualSize() + 0x1000);
+	// Only content that doesn't move with ASLR counts: the headers without ImageBase, and the VMP sections
+	// with every relocated pointer masked out.
+	std::vector<std::uint8_t> vecHeaders(buffer.begin(), buffer.begin() + std::min<std::size_t>(buffer.size(), pepp::PAGE_SIZE));
+	auto* pDosHdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(vecHeaders.data());
 
-	err = uc_mem_map(uc, uMappedTextAddress.uintptr(), uMappedTextSize.uintptr(), UC_PROT_ALL);
-	if (err != UC_ERR_OK)
+	if (pDosHdr->e_lfanew > 0 && pDosHdr->e_lfanew + sizeof(Header_t) <= vecHeaders.size())
+		reinterpret_cast<Header_t*>(vecHeaders.data() + pDosHdr->e_lfanew)->OptionalHeader.ImageBase = 0;
+
+	target.image_hash = vif::HashBytes(vecHeaders.data(), vecHeaders.size());
+
+	//
+	// The sections are hashed back to back, in section table order. (rva, offset into vecSection, size) of each.
+	std::vector<std::tuple<std::uint64_t, std::size_t, std::size_t>> vecRanges;
+	std::vector<std::uint8_t> vecSection;
+
+	for (pepp::SectionHeader* sec : vmp_sections)
 	{
-		logger->critical("Could not map in .text section => uc_mem_map() failed with error: {}", err);
-		return;
+		std::uint64_t uRva = std::min<std::uint64_t>(sec->GetVirtualAddress(), buffer.size());
+		std::size_t nSize = static_cast<std::size_t>(std::min<std::uint64_t>(sec->GetVirtualSize(), buffer.size() - uRva));
+
+		vecRanges.emplace_back(uRva, vecSection.size(), nSize);
+		vecSection.insert(vecSection.end(), buffer.begin() + uRva, buffer.begin() + uRva + nSize);
 	}
 
-	err = uc_mem_write(uc, uMappedTextAddress.uintptr(), &pTargetImg->buffer()[secText.GetVirtualAddress()], secText.GetVirtualSize());
-	if (err != UC_ERR_OK)
+	IMAGE_DATA_DIRECTORY dirReloc{};
+
+	if (pDosHdr->e_lfanew > 0 && pDosHdr->e_lfanew + sizeof(Header_t) <= vecHeaders.size())
+		dirReloc = reinterpret_cast<const Header_t*>(vecHeaders.data() + pDosHdr->e_lfanew)->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+
+	for (std::uint64_t uBlock = dirReloc.VirtualAddress;
+		dirReloc.VirtualAddress != 0 && uBlock + sizeof(IMAGE_BASE_RELOCATION) <= std::min<std::uint64_t>(dirReloc.VirtualAddress + dirReloc.Size, buffer.size());)
 	{
-		logger->critical("Could not map in .text section => uc_mem_write() failed with error: {}", err);
-		return;
+		IMAGE_BASE_RELOCATION block;
+		std::memcpy(&block, &buffer[uBlock], sizeof(block));
+
+		if (block.SizeOfBlock < sizeof(block) || uBlock + block.SizeOfBlock > buffer.size())
+			break;
+
+		for (std::uint64_t uEntry = uBlock + sizeof(block); uEntry + sizeof(std::uint16_t) <= uBlock + block.SizeOfBlock; uEntry += sizeof(std::uint16_t))
+		{
+			std::uint16_t entry;
+			std::memcpy(&entry, &buffer[uEntry], sizeof(entry));
+
+			if ((entry >> 12) != IMAGE_REL_BASED_HIGHLOW && (entry >> 12) != IMAGE_REL_BASED_DIR64)
+				continue;
+
+			std::uint64_t uRva = block.VirtualAddress + (entry & 0xfff);
+
+			for (auto& [uSecRva, nOffset, nSize] : vecRanges)
+			{
+				for (std::uint64_t i = uRva; i < uRva + sizeof(AddressType); ++i)
+				{
+					if (i >= uSecRva && i < uSecRva + nSize)
+						vecSection[nOffset + (i - uSecRva)] = 0;
+				}
+			}
+		}
+
+		uBlock += block.SizeOfBlock;
 	}
 
-	Address uMappedVmpAddress = (uImageBase + secVMP.GetVirtualAddress());
-	Address uMappedVmpSize = pepp::Align4kb(secVMP.GetVirtualSize() + 0x1000);
+	target.section_hash = vif::HashBytes(vecSection.data(), vecSection.size());
+}
+
+template<size_t BitSize>
+vif::CacheKey_t VMPImportFixer<BitSize>::GetCacheKey(const VifTarget_t& target, const VifImportCall_t& stub) const noexcept
+{
+	return { target.image_hash, target.section_hash, static_cast<std::uint32_t>(stub.destination - target.image_base), static_cast<std::uint8_t>(stub.variant) };
+}
 
-	err = uc_mem_map(uc, uMappedVmpAddress.uintptr(), uMappedVmpSize.uintptr(), UC_PROT_ALL);
-	if (err != UC_ERR_OK)
+template<size_t BitSize>
+bool VMPImportFixer<BitSize>::ResolveFromCache(vif::ResolutionCache& cache, const VifTarget_t& target, const VifImportCall_t& stub, VifResolvedImport_t& result)
+{
+	vif::CacheKey_t key = GetCacheKey(target, stub);
+	std::optional<vif::CacheEntry_t> entry = cache.Find(key);
+
+	if (!entry)
+		return false;
+
+	//
+	// The target is unchanged, the module the import lives in may not be. Only trust the entry if the export is
+	// still there, at the same RVA. An export without a name is looked up by its ordinal.
+	std::string sModule(entry->module_name);
+	std::transform(sModule.begin(), sModule.end(), sModule.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	auto it = m_ModulesByName.find(sModule);
+	pepp::ExportData_t exp{};
+	bool bFound = false;
+
+	if (it != m_ModulesByName.end())
 	{
-		logger->critical("Could not map in VMP section => uc_mem_map() failed with error: {}", err);
-		return;
+		auto& view = m_vecModuleViews[it->second];
+
+		bFound = entry->export_name.empty() ? view->FindExportByOrdinal(entry->ordinal, &exp) : view->FindExportByName(entry->export_name, &exp);
 	}
 
-	err = uc_mem_write(uc, uMappedVmpAddress.uintptr(), &pTargetImg->buffer()[secVMP.GetVirtualAddress()], secVMP.GetVirtualSize());
-	if (err != UC_ERR_OK)
+	if (!bFound || exp.rva != entry->export_rva)
 	{
-		logger->critical("Could not map in VMP section => uc_mem_write() failed with error: {}", err);
-		return;
+		std::string sExport = entry->export_name.empty() ? fmt::format("#{}", entry->ordinal) : std::string(entry->export_name);
+
+		logger->warn("Cached {}!{} for stub {:X} no longer holds, evicting it", entry->module_name, sExport, stub.destination);
+		cache.Evict(key);
+		return false;
 	}
 
-	//
-    // Write the stack address and registers
-	auto STACK_SPACE = (uMappedVmpAddress.uintptr() + (uMappedVmpSize.uintptr() - 0x1000)) & -0x10;
-	uc_reg_write(uc, STACK_REGISTER, &STACK_SPACE);
+	result.module_name = m_vecModuleList[it->second].module_name;
+	result.exp = exp;
+	result.resolved = true;
+	return true;
+}
 
-	//
-	// Temp data to hold info about resolved imports..
-	static std::pair<std::string, pepp::ExportData_t> ExpResolved{};
+template<size_t BitSize>
+void VMPImportFixer<BitSize>::IndexModules()
+{
+	for (std::size_t i = 0; i < m_vecModuleViews.size(); ++i)
+	{
+		if (!m_ModuleMap.Insert(m_vecModuleList[i].base_address, m_vecModuleList[i].module_size, i))
+			logger->error("Module {} overlaps another module, ignoring it for lookups", m_vecModuleList[i].module_path);
+
+		m_vecModuleList[i].module_name = std::filesystem::path(m_vecModuleList[i].module_path).filename().string();
 
+		std::string sName = m_vecModuleList[i].module_name;
+		std::transform(sName.begin(), sName.end(), sName.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		m_ModulesByName.try_emplace(sName, i);
+	}
+}
+
+template<size_t BitSize>
+bool VMPImportFixer<BitSize>::FixImports(std::string_view sModName)
+{
 	//
-	// We need to monitor every instruction that executes (since it seems like we cannot hook the 
-	// exact instruction we need (RET))
-	auto VifCodeHook = +[](uc_engine* uc, uint64_t address, uint32_t size, void* user_data)
+	// If no target module is selected, we default to the base process.
+	std::size_t nTargetIdx = 0;
+
+	for (std::size_t i = 0; !sModName.empty() && i < m_vecModuleViews.size(); ++i)
 	{
-		IVMPImportFixer* pUd = (IVMPImportFixer*)user_data;
+		if (m_vecModuleList[i].module_path.find(sModName) != std::string::npos)
+			nTargetIdx = i;
+	}
+
+	//
+	// Views of a warm fixer have been read from before, only this run's reads count.
+	std::size_t nBytesRead = 0;
 
-		uint8_t insnbuf[0xf];
-		uc_mem_read(uc, address, insnbuf, size);
+	for (auto& view : m_vecModuleViews)
+		nBytesRead += view->GetBytesRead();
 
-		ExpResolved.first.clear();
+	std::vector<VifTarget_t> vecTargets;
 
+	m_outputPaths.clear();
+
+	if (m_options.fix_all)
+	{
 		//
-		// Did we hit a RET?
-		if (insnbuf[0] == 0xC3 || insnbuf[0] == 0xC2)
+		// Only the section tables are read to find the targets, everything else is shared between them.
+		for (std::size_t i = 0; i < m_vecModuleViews.size(); ++i)
 		{
-			//
-			// Real import address is stored in [sp reg]
-			AddressType uImportAddress{};
-			VIFModuleInformation_t mod{};
-			pepp::ExportData_t exp{};
+			if (!HasVmpSection(i))
+				continue;
 
-			uc_reg_read(uc, STACK_REGISTER, &uImportAddress);
-			uc_mem_read(uc, uImportAddress, &uImportAddress, sizeof(uImportAddress));
+			const std::string& sName = m_vecModuleList[i].module_name;
+			vecTargets.push_back({ i, sName, GetOutputPath(sName) });
+		}
 
-			if (pUd->GetModuleFromAddress(uImportAddress, &mod))
-			{
-				if (!pUd->GetExportData(mod.base_address, uImportAddress - mod.base_address, &ExpResolved.second))
-				{
-					logger->critical("Could not find export from address {:X}", uImportAddress);
-					return;
-				}
+		if (vecTargets.empty())
+		{
+			logger->critical("No module carries a VMP (.vmp*) section!");
+			return false;
+		}
 
-				ExpResolved.first = std::filesystem::path(mod.module_path).filename().string();
+		logger->info("Found {} modules with a VMP section", vecTargets.size());
+	}
+	else
+	{
+		const std::string& sName = m_vecModuleList[nTargetIdx].module_name;
 
-				// logger->info("Resolved a call to {}!{}", ExpResolved.first, ExpResolved.second.name);
-				
-				//
-				// Stop emulation so we don't get a memory fetch error.
-				uc_emu_stop(uc);
-			}
-			else
+		vecTargets.push_back({ nTargetIdx, sName, GetOutputPath(sModName.empty() ? std::string_view(m_vecModuleList[0].module_name) : sModName) });
+	}
+
+	//
+	// A module that can't be fixed doesn't stop the others.
+	std::erase_if(vecTargets, [this](VifTarget_t& target) { return !PrepareTarget(target); });
+
+	if (vecTargets.empty())
+		return false;
+
+	//
+	// The stubs of every target go through the same pool in one go, minus those the cache already knows.
+	std::shared_ptr<vif::ResolutionCache> pCache;
+	std::vector<VifStubJob_t> vecJobs;
+	//! (target, stub) each job belongs to
+	std::vector<std::pair<std::size_t, std::size_t>> vecJobOwners;
+
+	//
+	// Jobs running side by side in daemon mode share the cache of a file, the file can only be opened once.
+	if (!m_options.cache_path.empty() && (pCache = vif::ResolutionCache::Acquire(m_options.cache_path)) == nullptr)
+		logger->warn("Unable to open the resolution cache {}, continuing without it", m_options.cache_path);
+
+	spdlog::stopwatch swCache;
+
+	for (std::size_t t = 0; t < vecTargets.size(); ++t)
+	{
+		VifTarget_t& target = vecTargets[t];
+		const VIFModuleInformation_t& mod = m_vecModuleList[target.index];
+
+		target.resolved.resize(target.stubs.size());
+
+		for (std::size_t s = 0; s < target.stubs.size(); ++s)
+		{
+			const VifImportCall_t& stub = target.stubs[s];
+
+			if (pCache && ResolveFromCache(*pCache, target, stub, target.resolved[s]))
 			{
-				logger->critical("Could not find module from address {:X}", uImportAddress);
-				return;
+				++m_stats.cache_hits;
+				continue;
 			}
+
+			vecJobs.push_back({ stub.destination, target.image_base + stub.offset + 5, mod.base_address, mod.base_address + mod.module_size });
+			vecJobOwners.emplace_back(t, s);
 		}
-	};
 
+		m_stats.call_sites += target.calls.size();
+		m_stats.unique_stubs += target.stubs.size();
+	}
 
-	if ((err=uc_hook_add(uc,
-		&code_hook,
-		UC_HOOK_CODE,
-		VifCodeHook,
-		this,
-		1,
-		0)) != UC_ERR_OK)
+	if (pCache)
 	{
-		logger->critical("Could not install a code hook: {}", err);
-		return;
+		m_stats.cache_misses = vecJobs.size();
+		m_metrics.AddPhase("cache", std::chrono::duration<double>(swCache.elapsed()).count());
+
+		logger->info("{} of {} unique stubs came from the cache", m_stats.cache_hits, m_stats.unique_stubs);
+	}
+
+	std::vector<VifResolvedImport_t> vecResolved;
+
+	if (!vecJobs.empty())
+	{
+		bool bReady = false;
+		{
+			VifScopedPhase phase(m_metrics, "engines");
+			bReady = PreparePool(vecTargets, vecJobs.size());
+		}
+
+		if (!bReady)
+			return false;
+
+		VifEmulatorPool<BitSize>& pool = *m_pool;
+
+		logger->info("Emulating {} unique stubs for {} calls in {} modules across {} engines",
+			vecJobs.size(), m_stats.call_sites, vecTargets.size(), pool.size());
+
+		spdlog::stopwatch sw;
+
+		pool.SetFastPath(m_options.fast_path, m_options.verify_fast_path);
+		pool.Resolve(vecJobs, vecResolved, { m_options.instruction_budget, m_options.time_budget_ms * 1000 });
+
+		double dEmulationTime = std::chrono::duration<double>(sw.elapsed()).count();
+
+		logger->info("Emulation took {:.3f}s ({:.0f} stubs/s)",
+			dEmulationTime, dEmulationTime > 0.0 ? vecJobs.size() / dEmulationTime : 0.0);
+
+		m_stats.pages_faulted = pool.GetPagesFaulted();
+		m_stats.retried_stubs = pool.GetRetriedStubs();
+		pool.GetFastPathStats(m_stats);
+
+		if (m_options.fast_path)
+		{
+			logger->info("Fast path resolved {} stubs, {} fell back to Unicorn ({} mismatches)",
+				m_stats.fast_path_stubs, m_stats.fast_path_fallbacks, m_stats.fast_path_mismatches);
+		}
+
+		m_metrics.AddPhase("emulation", dEmulationTime);
+		m_metrics.AddHistogram("instructions_per_stub", pool.GetInstructionHistogram());
+		m_metrics.AddHistogram("microseconds_per_stub", pool.GetTimeHistogram());
+
+		if (!m_options.keep_warm)
+			m_pool.reset();
 	}
 
 	//
-	// Locations of vmp import calls
-	std::vector<std::pair<Address, Address>> vecVmpImportCalls{};
+	// Hand every target its results, and remember them for the next run.
+	for (std::size_t j = 0; j < vecJobs.size(); ++j)
+	{
+		auto [t, s] = vecJobOwners[j];
+		VifTarget_t& target = vecTargets[t];
+
+		target.resolved[s] = vecResolved[j];
+
+		if (pCache && vecResolved[j].resolved)
+		{
+			//
+			// The cache is checked against raw export names, so the raw name is stored rather than the demangled one.
+			std::string sModule(vecResolved[j].module_name);
+			std::transform(sModule.begin(), sModule.end(), sModule.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+			auto it = m_ModulesByName.find(sModule);
+			pepp::ExportData_t raw{};
+
+			if (it != m_ModulesByName.end() && m_vecModuleViews[it->second]->FindExportByRva(vecResolved[j].exp.rva, &raw, false))
+				pCache->Add(GetCacheKey(target, target.stubs[s]), vecResolved[j].module_name, raw.name, static_cast<std::uint16_t>(raw.ordinal), raw.rva);
+		}
+	}
+
+	m_metrics.AddCounter("targets", vecTargets.size());
+
+	for (auto& target : vecTargets)
+		m_stats.resolved_stubs += std::count_if(target.resolved.begin(), target.resolved.end(), [](const VifResolvedImport_t& r) { return r.resolved; });
+
+	for (auto& view : m_vecModuleViews)
+		m_stats.bytes_read += view->GetBytesRead();
+
+	m_stats.bytes_read -= nBytesRead;
+
+	logger->info("Faulted in {} pages on demand, read {} KB across {} modules", m_stats.pages_faulted, m_stats.bytes_read / 1024, m_vecModuleViews.size());
+
+	logger->info("Resolved {}/{} unique stubs ({:.2f} call sites per stub)",
+		m_stats.resolved_stubs, m_stats.unique_stubs, m_stats.DeduplicationRatio());
+
 	//
-	// Cache of imports that were added.
-	std::unordered_map<std::string, std::unordered_map<std::string, uint32_t>> mAddedImports;
+	// Failures by reason, both as stubs and as the call sites left unpatched because of them.
+	std::array<std::pair<std::size_t, std::size_t>, static_cast<std::size_t>(VifFailure::Count)> aFailures{};
 
-	for (auto match : vecCallMatches)
+	for (auto& target : vecTargets)
 	{
-		ZydisDecodedInstruction insn{};
-		std::uint8_t* insnbuf = &pTargetImg->buffer()[match];
+		for (std::size_t s = 0; s < target.stubs.size(); ++s)
+		{
+			if (!target.resolved[s].resolved)
+				++aFailures[static_cast<std::size_t>(target.resolved[s].failure)].first;
+		}
 
-		if (DecodeInsn(insnbuf, insn))
+		for (std::size_t i = 0; i < target.calls.size(); ++i)
 		{
-			AddressType uDestAddress 
-				= CalculateAbsoluteAddress((uImageBase.uintptr() + match), insn);
-			if (uDestAddress == 0)
+			if (!target.resolved[target.stub_of_call[i]].resolved)
+				++aFailures[static_cast<std::size_t>(target.resolved[target.stub_of_call[i]].failure)].second;
+		}
+	}
+
+	if (m_stats.resolved_stubs != m_stats.unique_stubs)
+	{
+		logger->warn("Failed stubs by reason ({} retried with a larger budget):", m_stats.retried_stubs);
+
+		for (std::size_t f = 0; f < aFailures.size(); ++f)
+		{
+			if (aFailures[f].first == 0)
 				continue;
 
-			if (secVMP.HasVirtualAddress(uDestAddress - uImageBase.uintptr()))
-			{
-				logger->info("Found call to {} in {} @ {:X} (call to {:X})",
-					m_strVMPSectionName,
-					".text",
-					(AddressType)(uImageBase + match).uintptr(),
-					uDestAddress);
+			logger->warn("  {}: {} stubs, {} call sites", VifFailureName(static_cast<VifFailure>(f)), aFailures[f].first, aFailures[f].second);
+			m_metrics.AddCounter(fmt::format("failed_{}", VifFailureName(static_cast<VifFailure>(f))), aFailures[f].first);
+		}
+	}
 
-				vecVmpImportCalls.emplace_back((uint64_t)match, uDestAddress);
-			}
+	pCache.reset();
+
+	if (!m_options.site_log_path.empty())
+	{
+		try
+		{
+			//
+			// Fixers run side by side in daemon mode, and logger names have to be unique.
+			m_siteLog = spdlog::create_async<spdlog::sinks::basic_file_sink_mt>(fmt::format("sites_{}", fmt::ptr(this)), m_options.site_log_path, true);
+			m_siteLog->set_pattern("%v");
 		}
+		catch (const spdlog::spdlog_ex& ex)
+		{
+			logger->error("Unable to open the site log {}: {}", m_options.site_log_path, ex.what());
+		}
+	}
+
+	//
+	// Targets don't share anything past this point.
+	VifScopedPhase phase(m_metrics, "patch");
+	std::vector<std::thread> vecPatchers;
+
+	for (std::size_t i = 1; i < vecTargets.size(); ++i)
+		vecPatchers.emplace_back([this, &target = vecTargets[i]] { PatchTarget(target); });
+
+	PatchTarget(vecTargets[0]);
+
+	for (auto& patcher : vecPatchers)
+		patcher.join();
+
+	for (auto& target : vecTargets)
+		m_outputPaths.push_back(target.outpath);
+
+	if (m_siteLog)
+	{
+		m_siteLog->flush();
+		spdlog::drop(m_siteLog->name());
+		m_siteLog.reset();
+	}
+
+	return true;
+}
+
+template<size_t BitSize>
+std::string VMPImportFixer<BitSize>::GetOutputPath(std::string_view name) const
+{
+	return (std::filesystem::path(m_options.output_dir) / fmt::format("{}{}.fixed", name, m_options.output_suffix)).string();
+}
+
+template<size_t BitSize>
+bool VMPImportFixer<BitSize>::PreparePool(const std::vector<VifTarget_t>& targets, std::size_t jobs)
+{
+	std::vector<std::size_t> vecTargetIndices;
+	std::vector<VifMemoryRegion_t> vecRegions{};
+
+	for (auto& target : targets)
+	{
+		vecTargetIndices.push_back(target.index);
+		vecRegions.insert(vecRegions.end(), target.regions.begin(), target.regions.end());
+	}
+
+	//
+	// The regions point into the loaded target images, which a warm fixer keeps unpatched. Same targets and
+	// same sections means the engines still have the right memory mapped, and can go again as they are.
+	auto SameRegion = [](const VifMemoryRegion_t& a, const VifMemoryRegion_t& b)
+	{
+		return a.address == b.address && a.size == b.size && a.data == b.data && a.perms == b.perms;
+	};
+
+	if (m_pool && m_options.keep_warm && vecTargetIndices == m_poolTargets &&
+		std::equal(vecRegions.begin(), vecRegions.end(), m_poolRegions.begin(), m_poolRegions.end(), SameRegion))
+	{
+		logger->info("Reusing {} warm engines", m_pool->size());
+		m_pool->ResetCounters();
+		return true;
 	}
 
-	for (auto& address : vecVmpImportCalls)
+	m_pool.reset();
+	m_lazyMemory = std::make_unique<VifLazyMemoryMap>();
+
+	//
+	// Everything else is only mapped once a stub touches it. Only the targets are executable, a fetch from
+	// any other module is how a stub exiting into its import is detected.
+	for (auto& range : m_ModuleMap)
 	{
+		VifModuleView<BitSize>* pView = m_vecModuleViews[range.value].get();
+		bool bIsTarget = std::find(vecTargetIndices.begin(), vecTargetIndices.end(), range.value) != vecTargetIndices.end();
+		std::uint32_t uPerms = bIsTarget ? UC_PROT_READ | UC_PROT_EXEC : UC_PROT_READ;
+		std::uint64_t uMappedSize = (range.end - range.begin) & ~(std::uint64_t)(pepp::PAGE_SIZE - 1);
+
+		if (uMappedSize == 0)
+			continue;
+
 		//
-		// Reset stack.
-		uc_reg_write(uc, STACK_REGISTER, &STACK_SPACE);
+		// Modules that aren't in memory are read a page at a time, as the stubs touch them.
+		VifMemoryRegion_t region{ range.begin, uMappedSize, pView->GetData(), uPerms };
+
+		if (region.data == nullptr)
+			region.fetch = [pView](std::uint64_t offset) { return pView->GetPage(offset); };
 
 		//
-		// Write the return address as if we just entered a CALL.
-		uintptr_t stackptr{};
-		uintptr_t rtnaddress{ uImageBase.uintptr() + address.first.uintptr() + 5 };
+		// Stubs may spill into the writable sections, those pages get a private copy in every engine.
+		for (auto& sec : pView->GetSectionHeaders())
+		{
+			if ((sec.Characteristics & IMAGE_SCN_MEM_WRITE) == 0)
+				continue;
 
-		uc_reg_read(uc, STACK_REGISTER, &stackptr);
-		uc_mem_write(uc, stackptr, &rtnaddress, sizeof(rtnaddress));
+			std::uint64_t uSize = std::max<std::uint64_t>(sec.Misc.VirtualSize, sec.SizeOfRawData);
+			std::uint64_t uEnd = std::min<std::uint64_t>(sec.VirtualAddress + ((uSize + pepp::PAGE_SIZE - 1) & ~(std::uint64_t)(pepp::PAGE_SIZE - 1)), uMappedSize);
 
-		// logger->info("Starting emulation @ {:X}", address.second.uintptr());
+			if (sec.VirtualAddress < uEnd)
+				region.writable.push_back({ sec.VirtualAddress, static_cast<std::uint32_t>(uEnd) });
+		}
 
-		//
-		// Begin emulation.
-		uc_err uerr = uc_emu_start(uc, address.second.uintptr(), 0, 0, 0);
-		if (uerr != UC_ERR_OK)
+		m_lazyMemory->Insert(range.begin, uMappedSize, std::move(region));
+	}
+
+	//
+	// The stack gets its own region outside of every module, so a stub returning into a module
+	// is never mistaken for a stack access.
+	static constexpr std::uint64_t STACK_SIZE = 0x10000;
+	std::uint64_t uStackBase = m_ModuleMap.FindGap(STACK_SIZE, 0x10000, 0x10000);
+
+	if (uStackBase == 0 || (BitSize == 32 && uStackBase + STACK_SIZE > 0xffffffffull))
+	{
+		logger->critical("Unable to find space for the emulator stack!");
+		return false;
+	}
+
+	//
+	// No point in opening more engines than there are stubs, unless they're kept for the runs after.
+	std::size_t nWorkers = m_options.workers ? m_options.workers : std::thread::hardware_concurrency();
+
+	if (!m_options.keep_warm)
+		nWorkers = std::min(nWorkers, jobs);
+
+	m_pool = std::make_unique<VifEmulatorPool<BitSize>>(this, std::max<std::size_t>(nWorkers, 1));
+
+	if (!m_pool->Initialize(vecRegions, m_lazyMemory.get(), uStackBase, STACK_SIZE))
+	{
+		logger->critical("Unable to initialize the emulator pool.");
+		m_pool.reset();
+		return false;
+	}
+
+	m_poolTargets = std::move(vecTargetIndices);
+	m_poolRegions = std::move(vecRegions);
+	return true;
+}
+
+template<size_t BitSize>
+void VMPImportFixer<BitSize>::PatchTarget(VifTarget_t& target)
+{
+	pepp::Image<BitSize>* pTargetImg = target.image;
+	std::uint64_t uImageBase = target.image_base;
+
+	//
+	// A warm fixer keeps the loaded image as it is for the next run, and patches a copy of it instead.
+	if (m_options.keep_warm)
+	{
+		target.patched = m_vecModuleViews[target.index]->CopyImage();
+
+		if (!target.patched)
 		{
-			logger->error("Emulation failed with error: {}", uerr);
-			continue;
+			logger->critical("[{}] Unable to copy the image for patching!", target.name);
+			return;
 		}
 
-		if (ExpResolved.first.empty())
+		pTargetImg = &*target.patched;
+	}
+
+	//
+	// Gather every import that was resolved, and add them all to the import directory in one go.
+	pepp::ImportBatch_t mImports;
+
+	for (auto& resolved : target.resolved)
+	{
+		if (resolved.resolved)
+			mImports[resolved.module_name].insert(resolved.exp.name);
+	}
+
+	bool bAdded = false;
+	{
+		VifScopedPhase phase(m_metrics, "imports");
+		bAdded = pTargetImg->GetImportDirectory().AddImports(mImports);
+	}
+
+	if (!bAdded)
+	{
+		logger->critical("[{}] Unable to add the resolved imports to the import directory!", target.name);
+		return;
+	}
+
+	//
+	// Results are indexed by call, so patching happens in the same order regardless of the worker count.
+	//! Call sites patched, per module the imports come from
+	std::map<std::string_view, std::size_t> mPatched;
+	std::size_t nPatched = 0;
+
+	for (std::size_t i = 0; i < target.calls.size(); ++i)
+	{
+		const VifImportCall_t& call = target.calls[i];
+		const VifResolvedImport_t& ExpResolved = target.resolved[target.stub_of_call[i]];
+
+		if (!ExpResolved.resolved)
 		{
-			logger->error("Failed to resolve import @ emu address {:X}", address.second.uintptr());
+			logger->debug("Failed to resolve import @ emu address {:X} ({})", call.destination, VifFailureName(ExpResolved.failure));
+			LogSite(target, call, ExpResolved);
 			continue;
 		}
 
 		std::uint32_t uImportRVA{};
 		std::uint64_t uImportVA{};
 
-		if (mAddedImports.find(ExpResolved.first) != mAddedImports.end() && mAddedImports[ExpResolved.first][ExpResolved.second.name])
-		{
-			uImportRVA = mAddedImports[ExpResolved.first][ExpResolved.second.name];
-		}
-		else
+		if (!pTargetImg->GetImportDirectory().HasModuleImport(ExpResolved.module_name, ExpResolved.exp.name, &uImportRVA))
 		{
-			if (!pTargetImg->GetImportDirectory().HasModuleImport(ExpResolved.first, ExpResolved.second.name, &uImportRVA))
-				pTargetImg->GetImportDirectory().AddModuleImport(ExpResolved.first, ExpResolved.second.name, &uImportRVA);
-			mAddedImports[ExpResolved.first][ExpResolved.second.name] = uImportRVA;
+			logger->error("No IAT slot for {}!{}", ExpResolved.module_name, ExpResolved.exp.name);
+			LogSite(target, call, ExpResolved);
+			continue;
 		}
 
-		uImportVA = uImageBase.uintptr() + uImportRVA;
+		uImportVA = uImageBase + uImportRVA;
 
-		if (pTargetImg->buffer().deref<uint8_t>(address.first.uintptr() + 5) == 0xcc ||
-			pTargetImg->buffer().deref<uint8_t>(address.first.uintptr() + 5) == 0xc3)
+		if (call.variant == VifCallVariant::CallRet)
 		{
 			std::uint8_t patch_buf[6];
 			patch_buf[0] = 0xff;
 			patch_buf[1] = 0x15;
 			if constexpr (BitSize == 64)
-				*(std::uint32_t*)(&patch_buf[2]) = (std::uint32_t)(uImportVA - (uImageBase.uintptr() + address.first.uintptr()) - 6);
+				*(std::uint32_t*)(&patch_buf[2]) = (std::uint32_t)(uImportVA - (uImageBase + call.offset) - 6);
 			else
 			{
 				*(std::uint32_t*)(&patch_buf[2]) = (std::uint32_t)(uImportVA);
@@ -364,15 +895,15 @@ inline void VMPImportFixer<BitSize>::DumpInMemory(HANDLE hProcess, std::string_v
 			//
 			// Patch in
 			pTargetImg->buffer().copy_data(
-				address.first.uintptr(),
+				call.offset,
 				patch_buf,
 				sizeof(patch_buf)
 			);
 
-			logger->info("Patched import call @ 0x{:X} to {}!{}",
-				address.first.uintptr(),
-				ExpResolved.first,
-				ExpResolved.second.name);
+			logger->debug("Patched import call @ 0x{:X} to {}!{}",
+				call.offset,
+				ExpResolved.module_name,
+				ExpResolved.exp.name);
 		}
 		else
 		{
@@ -382,92 +913,108 @@ inline void VMPImportFixer<BitSize>::DumpInMemory(HANDLE hProcess, std::string_v
 			patch_buf[0] = 0xff;
 			patch_buf[1] = 0x15;
 			if constexpr (BitSize == 64)
-				*(std::uint32_t*)(&patch_buf[2]) = (std::uint32_t)(uImportVA - (uImageBase.uintptr() + (address.first.uintptr() - 1)) - 6);
+				*(std::uint32_t*)(&patch_buf[2]) = (std::uint32_t)(uImportVA - (uImageBase + (call.offset - 1)) - 6);
 			else
 				*(std::uint32_t*)(&patch_buf[2]) = (std::uint32_t)(uImportVA);
 
 			//
 			// Patch in
 			pTargetImg->buffer().copy_data(
-				address.first.uintptr() - 1,
+				call.offset - 1,
 				patch_buf,
 				sizeof(patch_buf)
 			);
 
-			logger->info("Patched import call @ 0x{:X} to {}!{}",
-				address.first.uintptr(),
-				ExpResolved.first,
-				ExpResolved.second.name);
+			logger->debug("Patched import call @ 0x{:X} to {}!{}",
+				call.offset,
+				ExpResolved.module_name,
+				ExpResolved.exp.name);
 		}
-	}
 
-	std::string outpath = "dumps/";
-	if (sModName.empty()) 
-	{
-		outpath += std::filesystem::path(m_vecModuleList[0].module_path).filename().string() + ".fixed";
-	}
-	else
-	{
-		outpath += std::string(sModName) + ".fixed";
+		++mPatched[ExpResolved.module_name];
+		++nPatched;
+		LogSite(target, call, ExpResolved, true);
 	}
 
-	logger->info("Finished, writing to {}", outpath);
+	//
+	// One line for the whole target instead of one per site.
+	std::string sSummary;
+
+	for (auto& [module, count] : mPatched)
+		sSummary += fmt::format("{}{} {}", sSummary.empty() ? "" : ", ", module, count);
+
+	logger->info("[{}] Patched {}/{} call sites ({})", target.name, nPatched, target.calls.size(), sSummary);
+	m_metrics.AddCounter("patched_sites", nPatched);
+	logger->info("Finished, writing to {}", target.outpath);
 
-	pTargetImg->WriteToFile(outpath);
+	VifScopedPhase phase(m_metrics, "write");
+	pTargetImg->WriteToFile(target.outpath);
 }
 
 template<size_t BitSize>
-bool VMPImportFixer<BitSize>::DecodeInsn(pepp::Address<> address, ZydisDecodedInstruction& insn) const noexcept
+void VMPImportFixer<BitSize>::LogSite(const VifTarget_t& target, const VifImportCall_t& call, const VifResolvedImport_t& resolved, bool patched)
 {
-	return ZYAN_SUCCESS(ZydisDecoderDecodeBuffer(&m_decoder, address.as_ptr<void>(), 0xff, &insn));
+	if (!m_siteLog)
+		return;
+
+	//
+	// Names are file names and export names, neither can hold a quote or a backslash.
+	if (patched)
+	{
+		m_siteLog->info(R"({{"module":"{}","rva":{},"stub":{},"variant":"{}","status":"patched","import":"{}","export":"{}"}})",
+			target.name, call.offset, call.destination, call.variant == VifCallVariant::CallRet ? "call_ret" : "push_call",
+			resolved.module_name, resolved.exp.name);
+	}
+	else
+	{
+		m_siteLog->info(R"({{"module":"{}","rva":{},"stub":{},"variant":"{}","status":"failed","reason":"{}"}})",
+			target.name, call.offset, call.destination, call.variant == VifCallVariant::CallRet ? "call_ret" : "push_call",
+			resolved.resolved ? "no_iat_slot" : VifFailureName(resolved.failure));
+	}
 }
 
 template<size_t BitSize>
-std::uintptr_t VMPImportFixer<BitSize>::CalculateAbsoluteAddress(std::uintptr_t runtime_address, ZydisDecodedInstruction& insn) const noexcept
+void VMPImportFixer<BitSize>::WriteMetrics(double total_seconds)
 {
-	std::uintptr_t result{};
-
-	if (ZYAN_SUCCESS(ZydisCalcAbsoluteAddress(&insn, &insn.operands[0], runtime_address, &result)))
-		return result;
+	m_metrics.AddPhase("total", total_seconds);
+
+	m_metrics.AddCounter("modules", m_vecModuleList.size());
+	m_metrics.AddCounter("call_sites", m_stats.call_sites);
+	m_metrics.AddCounter("unique_stubs", m_stats.unique_stubs);
+	m_metrics.AddCounter("resolved_stubs", m_stats.resolved_stubs);
+	m_metrics.AddCounter("cache_hits", m_stats.cache_hits);
+	m_metrics.AddCounter("cache_misses", m_stats.cache_misses);
+	m_metrics.AddCounter("retried_stubs", m_stats.retried_stubs);
+	m_metrics.AddCounter("fast_path_stubs", m_stats.fast_path_stubs);
+	m_metrics.AddCounter("fast_path_fallbacks", m_stats.fast_path_fallbacks);
+	m_metrics.AddCounter("fast_path_mismatches", m_stats.fast_path_mismatches);
+	m_metrics.AddCounter("pages_faulted", m_stats.pages_faulted);
+	m_metrics.AddCounter("bytes_read", m_stats.bytes_read);
+
+	if (m_options.metrics_path.empty())
+		return;
 
-	return 0ull;
+	if (!m_metrics.WriteJson(m_options.metrics_path))
+		logger->error("Unable to write metrics to {}", m_options.metrics_path);
+	else
+		logger->info("Wrote metrics to {}", m_options.metrics_path);
 }
 
 template<size_t BitSize>
-bool VMPImportFixer<BitSize>::GetModuleFromAddress(std::uintptr_t ptr, VIFModuleInformation_t* pmod)
+const VIFModuleInformation_t* VMPImportFixer<BitSize>::GetModuleFromAddress(std::uintptr_t ptr) const
 {
-	if (m_vecModuleList.empty())
-		return false;
-
-	for (auto& mod : m_vecModuleList)
-	{
-		if (ptr >= mod.base_address && ptr <= mod.base_address + mod.module_size)
-		{
-			*pmod = mod;
-			return true;
-		}
-	}
+	const std::size_t* pIdx = m_ModuleMap.FindValue(ptr);
 
-	return false;
+	return pIdx ? &m_vecModuleList[*pIdx] : nullptr;
 }
 
 template<size_t BitSize>
 bool VMPImportFixer<BitSize>::GetExportData(std::uintptr_t mod, std::uintptr_t rva, pepp::ExportData_t* exp)
 {
-	pepp::Image<BitSize>* pImage = m_ImageMap[mod];
-	bool bFound = false;
+	const std::size_t* pIdx = m_ModuleMap.FindValue(mod);
 
-	if (pImage)
-	{
-		pImage->GetExportDirectory().TraverseExports([&bFound, &exp, rva](pepp::ExportData_t* tmp)
-			{
-				if (tmp->rva == rva)
-				{
-					*exp = *tmp;
-					bFound = true;
-				}
-			});
-	}
+	if (pIdx == nullptr)
+		return false;
 
-	return bFound;
+	return m_vecModuleViews[*pIdx]->FindExportByRva(static_cast<std::uint32_t>(rva), exp);
 }
@@ -9,12 +9,22 @@
 #include <string>
 #include <string_view>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <TlHelp32.h>
 #include <algorithm>
 #include <memory>
 #include <inttypes.h>
 #include <filesystem>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <functional>
+#include <deque>
+#include <array>
 #pragma comment(lib, "psapi.lib")
 
 //! PE parsing and manipulation and some other utils.
@@ -31,40 +41,179 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/async.h>
 #include <spdlog/stopwatch.h>
 #include <spdlog/fmt/bin_to_hex.h>
 
+#include "msc/MemorySource.hpp"
+#include "msc/ProcessMemorySource.hpp"
 #include "VIFTools.hpp"
+#include "VIFModuleView.hpp"
+#include "msc/Snapshot.hpp"
+#include "msc/ResolutionCache.hpp"
+#include "msc/AddressSpaceMap.hpp"
+#include "VIFCallScanner.hpp"
+#include "VIFGuestMemory.hpp"
+#include "VIFMetrics.hpp"
+#include "VIFEmulator.hpp"
+#include "VIFMicroEmulator.hpp"
+
+//! Settings taken from the command line
+struct VifOptions_t
+{
+	//! VMP sections the calls lead into, only .vmp0 if none are given.
+	std::vector<std::string> section_names{};
+	//! Number of emulation engines, 0 uses one per hardware thread.
+	std::size_t		workers = 0;
+	//! Fix every module carrying a VMP section, instead of a single one.
+	bool			fix_all = false;
+	//! Resolutions are kept here across runs, if set.
+	std::string		cache_path{};
+	//! Per stub limits, 0 picks one from the stubs resolved so far.
+	std::uint64_t	instruction_budget = 0;
+	std::uint64_t	time_budget_ms = 0;
+	//! Try the micro emulator before Unicorn.
+	bool			fast_path = true;
+	//! Run Unicorn on fast path stubs as well, and report any difference.
+	bool			verify_fast_path = false;
+	//! Run metrics are written here as JSON, if set.
+	std::string		metrics_path{};
+	//! One JSON line per call site is written here, if set.
+	std::string		site_log_path{};
+	//! Leave the loaded images unpatched and keep the engines, so the same fixer can be run again.
+	bool			keep_warm = false;
+	//! Fixed images are written here, as <module><output_suffix>.fixed.
+	std::string		output_dir = "dumps";
+	std::string		output_suffix{};
+};
 
 class IVMPImportFixer
 {
 public:
 	virtual ~IVMPImportFixer() = default;
-	virtual bool GetModuleFromAddress(std::uintptr_t ptr, VIFModuleInformation_t* mod) = 0;
-	virtual void DumpInMemory(HANDLE hProcess, std::string_view sModName) = 0;
+	virtual const VIFModuleInformation_t* GetModuleFromAddress(std::uintptr_t ptr) const = 0;
+	virtual bool DumpInMemory(HANDLE hProcess, std::string_view sModName) = 0;
+	virtual bool DumpFromSnapshot(const vif::Snapshot& snapshot, std::string_view sModName) = 0;
 	virtual bool GetExportData(std::uintptr_t mod, std::uintptr_t rva, pepp::ExportData_t* exp) = 0;
+	virtual void SetOptions(const VifOptions_t& options) = 0;
+	virtual const VifMetrics& GetMetrics() const = 0;
+	virtual const std::vector<std::string>& GetOutputPaths() const = 0;
 };
 
 template<size_t BitSize>
 class VMPImportFixer : public pepp::msc::NonCopyable, public IVMPImportFixer
 {
 public:
-	VMPImportFixer(std::string_view vmpsn) noexcept;
+	VMPImportFixer(const VifOptions_t& options) noexcept;
 	
-	void DumpInMemory(HANDLE hProcess, std::string_view sModName) final override;
-
-	//! Zydis disassemble an instruction.
-	bool DecodeInsn(pepp::Address<> address, ZydisDecodedInstruction& insn) const noexcept;
-	std::uintptr_t CalculateAbsoluteAddress(std::uintptr_t runtime_address, ZydisDecodedInstruction& insn) const noexcept;
-
-	bool GetModuleFromAddress(std::uintptr_t ptr, VIFModuleInformation_t* mod) final override;
+	//! Fix the target module(s), returns false if nothing could be patched.
+	bool DumpInMemory(HANDLE hProcess, std::string_view sModName) final override;
+
+	//! Same as DumpInMemory, off of a snapshot. Modules are only loaded on the first run, with `keep_warm`
+	//! every run after that has to be on the same snapshot.
+	bool DumpFromSnapshot(const vif::Snapshot& snapshot, std::string_view sModName) final override;
+
+	//! Options for the next run
+	void SetOptions(const VifOptions_t& options) final override {
+		m_options = options;
+	}
+
+	//! Metrics of the last run, complete whether or not they were written out.
+	const VifMetrics& GetMetrics() const final override {
+		return m_metrics;
+	}
+
+	//! Files the fixed images of the last run were written to
+	const std::vector<std::string>& GetOutputPaths() const final override {
+		return m_outputPaths;
+	}
+
+	//! Find the module containing an address
+	//! - returns nullptr if the address does not lie within any module.
+	const VIFModuleInformation_t* GetModuleFromAddress(std::uintptr_t ptr) const final override;
 	bool GetExportData(std::uintptr_t mod, std::uintptr_t rva, pepp::ExportData_t* exp) final override;
 private:
-	ZydisDecoder						m_decoder;
-	std::string							m_strVMPSectionName;
+	//! A module being fixed, along with everything found in it.
+	struct VifTarget_t
+	{
+		std::size_t							index;
+		std::string							name;
+		std::string							outpath;
+		pepp::Image<BitSize>*				image = nullptr;
+		std::uint64_t						image_base = 0;
+		//! Identify the target in the resolution cache
+		std::uint64_t						image_hash = 0;
+		std::uint64_t						section_hash = 0;
+		//! The code and VMP sections, mapped up front
+		std::vector<VifMemoryRegion_t>		regions;
+		std::vector<VifImportCall_t>		calls;
+		//! One per (stub, variant) pair, `stub_of_call[i]` is the one emulated for `calls[i]`.
+		std::vector<VifImportCall_t>		stubs;
+		std::vector<std::size_t>			stub_of_call;
+		std::vector<VifResolvedImport_t>	resolved;
+		//! With `keep_warm` this copy of `image` is patched instead.
+		std::optional<pepp::Image<BitSize>>	patched;
+	};
+
+	//! Map module ranges and names to their index, once the module lists are filled.
+	void IndexModules();
+
+	//! Resolve and patch all import calls of the target module(s), once the modules are indexed.
+	bool FixImports(std::string_view sModName);
+
+	//! Where the fixed image of a module goes
+	std::string GetOutputPath(std::string_view name) const;
+
+	//! Set up the engines for the targets, a warm pool is kept if the targets map the same regions.
+	bool PreparePool(const std::vector<VifTarget_t>& targets, std::size_t jobs);
+
+	//! Whether a section is one of the VMP sections asked for
+	bool IsVmpSectionName(std::string_view name) const noexcept;
+
+	//! Check the section table of a module for a VMP section, without reading the rest of it.
+	bool HasVmpSection(std::size_t idx) const;
+
+	//! Find the VMP sections of an image, by name or failing that every ".vmp" section when fixing every module.
+	std::vector<pepp::SectionHeader*> FindVmpSections(pepp::Image<BitSize>& img) const;
+
+	//! Read the target in full, find its sections and the calls into the VMP sections.
+	bool PrepareTarget(VifTarget_t& target);
+
+	//! Hash what identifies the target across runs, independent of where it was loaded.
+	void HashTarget(VifTarget_t& target, const std::vector<pepp::SectionHeader*>& vmp_sections) const;
+
+	vif::CacheKey_t GetCacheKey(const VifTarget_t& target, const VifImportCall_t& stub) const noexcept;
+
+	//! Fill `result` from the cache, if the entry still matches the loaded modules (otherwise it is evicted).
+	bool ResolveFromCache(vif::ResolutionCache& cache, const VifTarget_t& target, const VifImportCall_t& stub, VifResolvedImport_t& result);
+
+	//! Add the resolved imports, patch the call sites and write the fixed image out.
+	void PatchTarget(VifTarget_t& target);
+
+	//! Write a call site to the site log, if there is one.
+	void LogSite(const VifTarget_t& target, const VifImportCall_t& call, const VifResolvedImport_t& resolved, bool patched = false);
+
+	//! Add the run totals to the metrics and write them out, if asked for.
+	void WriteMetrics(double total_seconds);
+
+	VifOptions_t						m_options;
 	std::vector<VIFModuleInformation_t>	m_vecModuleList;
-	std::vector<pepp::Image<BitSize>>	m_vecImageList;
-	std::map<pepp::Address<>, pepp::Image<BitSize>*> m_ImageMap;
+	//! Modules are only read as far as they're used, only the target gets a full image.
+	std::vector<std::unique_ptr<VifModuleView<BitSize>>> m_vecModuleViews;
+	//! Module ranges, mapped to their index in m_vecModuleList/m_vecModuleViews
+	vif::AddressSpaceMap<std::size_t>	m_ModuleMap;
+	//! Lower case module file names, to their index
+	std::unordered_map<std::string, std::size_t> m_ModulesByName;
+	VifResolutionStats_t				m_stats;
+	VifMetrics							m_metrics;
+	std::vector<std::string>			m_outputPaths;
+	//! Async, lines are formatted on the patching threads and written by spdlog's pool.
+	std::shared_ptr<spdlog::logger>		m_siteLog;
+	//! The targets and regions the pool was set up for. The lazy map has to outlive the pool.
+	std::vector<std::size_t>			m_poolTargets;
+	std::vector<VifMemoryRegion_t>		m_poolRegions;
+	std::unique_ptr<VifLazyMemoryMap>	m_lazyMemory;
+	std::unique_ptr<VifEmulatorPool<BitSize>> m_pool;
 };
 
 
@@ -72,9 +221,15 @@ private:
 extern std::shared_ptr<spdlog::logger> logger;
 
 template<size_t BitSize>
-inline VMPImportFixer<BitSize>::VMPImportFixer(std::string_view vmpsn) noexcept
-	: m_strVMPSectionName(vmpsn)
+inline VMPImportFixer<BitSize>::VMPImportFixer(const VifOptions_t& options) noexcept
+	: m_options(options)
 {
 }
 
+template<size_t BitSize>
+IVMPImportFixer* VifFactory_GenerateFixer(const VifOptions_t& options) noexcept
+{
+	return new VMPImportFixer<BitSize>(options);
+}
 
+#include "VIFDaemon.hpp"
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <pepp/misc/NonCopyable.hpp>
+
+namespace vif
+{
+	///
+	//! class AddressSpaceMap
+	//! Sorted table of non-overlapping [begin, end) ranges with a binary search lookup.
+	//! The last range hit is kept in a hot slot, since lookups tend to land in the same module repeatedly.
+	///
+	template<typename T>
+	class AddressSpaceMap : pepp::msc::NonCopyable
+	{
+	public:
+		struct Range_t
+		{
+			std::uint64_t	begin;
+			std::uint64_t	end;
+			T				value;
+
+			bool Contains(std::uint64_t address) const noexcept {
+				return address >= begin && address < end;
+			}
+		};
+
+		AddressSpaceMap() = default;
+
+		//! Insert a range
+		//! - returns false if the range is empty or overlaps an existing one.
+		bool Insert(std::uint64_t begin, std::uint64_t size, T value)
+		{
+			if (size == 0 || begin + size < begin)
+				return false;
+
+			auto it = std::lower_bound(m_ranges.begin(), m_ranges.end(), begin, [](const Range_t& range, std::uint64_t address)
+				{
+					return range.begin < address;
+				});
+
+			if (it != m_ranges.end() && it->begin < begin + size)
+				return false;
+
+			if (it != m_ranges.begin() && (it - 1)->end > begin)
+				return false;
+
+			m_ranges.insert(it, Range_t{ begin, begin + size, std::move(value) });
+			m_lastHit.store(0, std::memory_order_relaxed);
+			return true;
+		}
+
+		//! Find the range containing an address
+		//! - returns nullptr if no range contains it.
+		const Range_t* Find(std::uint64_t address) const noexcept
+		{
+			std::size_t hit = m_lastHit.load(std::memory_order_relaxed);
+
+			if (hit < m_ranges.size() && m_ranges[hit].Contains(address))
+				return &m_ranges[hit];
+
+			auto it = std::upper_bound(m_ranges.begin(), m_ranges.end(), address, [](std::uint64_t address, const Range_t& range)
+				{
+					return address < range.begin;
+				});
+
+			if (it == m_ranges.begin() || !(it - 1)->Contains(address))
+				return nullptr;
+
+			--it;
+			m_lastHit.store(static_cast<std::size_t>(it - m_ranges.begin()), std::memory_order_relaxed);
+			return &*it;
+		}
+
+		//! Find the value of the range containing an address
+		const T* FindValue(std::uint64_t address) const noexcept
+		{
+			const Range_t* range = Find(address);
+			return range ? &range->value : nullptr;
+		}
+
+		//! Find the lowest `alignment` aligned gap of at least `size` bytes at or above `minimum`
+		//! - returns 0 if there is none.
+		std::uint64_t FindGap(std::uint64_t size, std::uint64_t minimum, std::uint64_t alignment) const noexcept
+		{
+			std::uint64_t candidate = (minimum + alignment - 1) & ~(alignment - 1);
+
+			for (auto& range : m_ranges)
+			{
+				if (range.end <= candidate)
+					continue;
+
+				if (range.begin >= candidate + size)
+					return candidate;
+
+				candidate = (range.end + alignment - 1) & ~(alignment - 1);
+			}
+
+			return candidate + size > candidate ? candidate : 0;
+		}
+
+		void Clear() noexcept
+		{
+			m_ranges.clear();
+			m_lastHit.store(0, std::memory_order_relaxed);
+		}
+
+		std::size_t size() const noexcept {
+			return m_ranges.size();
+		}
+
+		bool empty() const noexcept {
+			return m_ranges.empty();
+		}
+
+		auto begin() const noexcept {
+			return m_ranges.cbegin();
+		}
+
+		auto end() const noexcept {
+			return m_ranges.cend();
+		}
+
+	private:
+		std::vector<Range_t>				m_ranges;
+		mutable std::atomic<std::size_t>	m_lastHit{ 0 };
+	};
+}
@@ -0,0 +1,202 @@
+#include "MemorySource.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+
+using namespace vif;
+
+void IMemorySource::PushRange(std::vector<MemoryRange_t>& ranges, std::uint64_t begin, std::uint64_t end)
+{
+	if (begin >= end)
+		return;
+
+	if (!ranges.empty() && ranges.back().end == begin)
+		ranges.back().end = end;
+	else
+		ranges.push_back({ begin, end });
+}
+
+std::size_t IMemorySource::Read(std::uint64_t address, void* buffer, std::size_t size, std::size_t workers) const
+{
+	std::uint8_t* pBuffer = static_cast<std::uint8_t*>(buffer);
+
+	//
+	// Whatever isn't covered by a readable range stays zeroed.
+	std::memset(pBuffer, 0, size);
+
+	std::vector<MemoryRange_t> vecRanges = QueryRanges(address, size);
+
+	auto ReadOne = [&](const MemoryRange_t& range)
+	{
+		return ReadRange(range.begin, pBuffer + (range.begin - address), static_cast<std::size_t>(range.end - range.begin));
+	};
+
+	if (workers == 0)
+		workers = std::thread::hardware_concurrency();
+
+	workers = std::max<std::size_t>(std::min(workers, vecRanges.size()), 1);
+
+	if (workers == 1)
+	{
+		std::size_t nRead = 0;
+
+		for (auto& range : vecRanges)
+			nRead += ReadOne(range);
+
+		return nRead;
+	}
+
+	std::atomic<std::size_t> nNext{ 0 };
+	std::atomic<std::size_t> nRead{ 0 };
+	std::vector<std::thread> vecThreads;
+
+	for (std::size_t i = 0; i < workers; ++i)
+	{
+		vecThreads.emplace_back([&]
+			{
+				for (std::size_t idx; (idx = nNext.fetch_add(1)) < vecRanges.size();)
+					nRead.fetch_add(ReadOne(vecRanges[idx]));
+			});
+	}
+
+	for (auto& thread : vecThreads)
+		thread.join();
+
+	return nRead.load();
+}
+
+bool BufferMemorySource::AddRange(std::uint64_t address, const std::uint8_t* data, std::size_t size)
+{
+	if (data == nullptr || size == 0)
+		return false;
+
+	auto it = std::lower_bound(m_ranges.begin(), m_ranges.end(), address, [](const BufferRange_t& range, std::uint64_t value)
+		{
+			return range.address < value;
+		});
+
+	if (it != m_ranges.end() && it->address < address + size)
+		return false;
+
+	if (it != m_ranges.begin() && (it - 1)->address + (it - 1)->size > address)
+		return false;
+
+	m_ranges.insert(it, BufferRange_t{ address, data, size });
+	return true;
+}
+
+std::vector<MemoryRange_t> BufferMemorySource::QueryRanges(std::uint64_t address, std::size_t size) const
+{
+	std::vector<MemoryRange_t> vecRanges;
+	std::uint64_t uEnd = address + size;
+
+	for (auto& range : m_ranges)
+	{
+		if (range.address >= uEnd)
+			break;
+
+		PushRange(vecRanges, std::max(address, range.address), std::min(uEnd, range.address + range.size));
+	}
+
+	return vecRanges;
+}
+
+std::size_t BufferMemorySource::ReadRange(std::uint64_t address, void* buffer, std::size_t size) const
+{
+	std::size_t nTotal = 0;
+	std::uint64_t uEnd = address + size;
+
+	//
+	// A coalesced range can span several buffers.
+	for (auto& range : m_ranges)
+	{
+		std::uint64_t uBegin = std::max(address, range.address);
+		std::uint64_t uStop = std::min(uEnd, range.address + range.size);
+
+		if (uBegin >= uStop)
+			continue;
+
+		std::memcpy(static_cast<std::uint8_t*>(buffer) + (uBegin - address), range.data + (uBegin - range.address), static_cast<std::size_t>(uStop - uBegin));
+		nTotal += static_cast<std::size_t>(uStop - uBegin);
+	}
+
+	return nTotal;
+}
+
+bool FileMemorySource::AddFile(std::string_view path, std::uint64_t address)
+{
+	std::error_code ec;
+	std::uint64_t uSize = std::filesystem::file_size(std::filesystem::path(path), ec);
+
+	if (ec || uSize == 0 || address + uSize < address)
+		return false;
+
+	auto it = std::lower_bound(m_ranges.begin(), m_ranges.end(), address, [](const FileRange_t& range, std::uint64_t value)
+		{
+			return range.address < value;
+		});
+
+	if (it != m_ranges.end() && it->address < address + uSize)
+		return false;
+
+	if (it != m_ranges.begin() && (it - 1)->address + (it - 1)->size > address)
+		return false;
+
+	auto file = std::make_unique<DumpFile_t>();
+
+	file->stream.open(std::string(path), std::ios::binary);
+	if (!file->stream)
+		return false;
+
+	m_ranges.insert(it, FileRange_t{ address, uSize, std::move(file) });
+	return true;
+}
+
+std::vector<MemoryRange_t> FileMemorySource::QueryRanges(std::uint64_t address, std::size_t size) const
+{
+	std::vector<MemoryRange_t> vecRanges;
+	std::uint64_t uEnd = address + size;
+
+	for (auto& range : m_ranges)
+	{
+		if (range.address >= uEnd)
+			break;
+
+		PushRange(vecRanges, std::max(address, range.address), std::min(uEnd, range.address + range.size));
+	}
+
+	return vecRanges;
+}
+
+std::size_t FileMemorySource::ReadRange(std::uint64_t address, void* buffer, std::size_t size) const
+{
+	std::size_t nTotal = 0;
+	std::uint64_t uEnd = address + size;
+
+	//
+	// A coalesced range can span several files.
+	for (auto& range : m_ranges)
+	{
+		std::uint64_t uBegin = std::max(address, range.address);
+		std::uint64_t uStop = std::min(uEnd, range.address + range.size);
+
+		if (uBegin >= uStop)
+			continue;
+
+		std::lock_guard lock(range.file->lock);
+		std::ifstream& stream = range.file->stream;
+
+		//
+		// A short read earlier (the file shrank) leaves the stream failed, the next read starts afresh.
+		stream.clear();
+		stream.seekg(static_cast<std::streamoff>(uBegin - range.address));
+		stream.read(reinterpret_cast<char*>(buffer) + (uBegin - address), static_cast<std::streamsize>(uStop - uBegin));
+
+		nTotal += static_cast<std::size_t>(stream.gcount());
+	}
+
+	return nTotal;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+//
+// Only the standard library, so memory sources can be built and tested off of Windows.
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include <pepp/misc/NonCopyable.hpp>
+
+namespace vif
+{
+	//! A readable [begin, end) range of a memory source
+	struct MemoryRange_t
+	{
+		std::uint64_t begin;
+		std::uint64_t end;
+	};
+
+	///
+	//! class IMemorySource
+	//! Where the target's memory is read from. Sources only describe what is readable and read
+	//! single readable ranges, batching and zero filling is shared by all of them.
+	///
+	class IMemorySource : pepp::msc::NonCopyable
+	{
+	public:
+		virtual ~IMemorySource() = default;
+
+		//! Readable ranges overlapping [address, address + size), clipped to it and sorted.
+		//! - Adjacent readable ranges come back as one.
+		virtual std::vector<MemoryRange_t> QueryRanges(std::uint64_t address, std::size_t size) const = 0;
+
+		//! Read a range returned by QueryRanges(), or a part of one
+		//! - returns the number of bytes read, what couldn't be read is left alone.
+		virtual std::size_t ReadRange(std::uint64_t address, void* buffer, std::size_t size) const = 0;
+
+		//! Read [address, address + size), one read per readable range, ranges are read in parallel.
+		//! - Unreadable bytes are zero filled, nothing is ever reprotected.
+		//! - `workers` of 0 uses one thread per hardware thread.
+		//! - returns the number of bytes actually read.
+		std::size_t Read(std::uint64_t address, void* buffer, std::size_t size, std::size_t workers = 1) const;
+
+	protected:
+		//! Append [begin, end) to `ranges`, merging it into the last range if they touch.
+		static void PushRange(std::vector<MemoryRange_t>& ranges, std::uint64_t begin, std::uint64_t end);
+	};
+
+	///
+	//! class BufferMemorySource
+	//! Memory that is already at hand, e.g the mapped view of a snapshot. Buffers are borrowed.
+	///
+	class BufferMemorySource : public IMemorySource
+	{
+	public:
+		BufferMemorySource() = default;
+
+		//! Make `size` bytes at `data` readable at `address`
+		//! - returns false if it overlaps a range added before.
+		bool AddRange(std::uint64_t address, const std::uint8_t* data, std::size_t size);
+
+		std::vector<MemoryRange_t> QueryRanges(std::uint64_t address, std::size_t size) const final override;
+		std::size_t ReadRange(std::uint64_t address, void* buffer, std::size_t size) const final override;
+
+	private:
+		struct BufferRange_t
+		{
+			std::uint64_t		address;
+			const std::uint8_t*	data;
+			std::size_t			size;
+		};
+
+		//! Sorted by address
+		std::vector<BufferRange_t>	m_ranges;
+	};
+
+	///
+	//! class FileMemorySource
+	//! Raw dump files, each holding the memory starting at its address as-is. Files are read as the ranges
+	//! are asked for, nothing is kept in memory.
+	///
+	class FileMemorySource : public IMemorySource
+	{
+	public:
+		FileMemorySource() = default;
+
+		//! Make the contents of a dump file readable at `address`
+		//! - returns false if it can't be opened, is empty or overlaps a file added before.
+		bool AddFile(std::string_view path, std::uint64_t address);
+
+		std::vector<MemoryRange_t> QueryRanges(std::uint64_t address, std::size_t size) const final override;
+		std::size_t ReadRange(std::uint64_t address, void* buffer, std::size_t size) const final override;
+
+	private:
+		//! Streams can't be read from two threads at once, every file gets its own lock.
+		struct DumpFile_t
+		{
+			std::ifstream	stream;
+			std::mutex		lock;
+		};
+
+		struct FileRange_t
+		{
+			std::uint64_t				address;
+			std::uint64_t				size;
+			std::unique_ptr<DumpFile_t>	file;
+		};
+
+		//! Sorted by address
+		std::vector<FileRange_t>	m_ranges;
+	};
+}
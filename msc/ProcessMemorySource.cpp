@@ -0,0 +1,56 @@
+#include "../VMPImportFixer.hpp"
+
+using namespace vif;
+
+ProcessMemorySource::ProcessMemorySource(HANDLE hProcess) noexcept
+	: m_process(hProcess)
+{
+}
+
+std::vector<MemoryRange_t> ProcessMemorySource::QueryRanges(std::uint64_t address, std::size_t size) const
+{
+	std::vector<MemoryRange_t> vecRanges;
+	std::uint64_t uEnd = address + size;
+	MEMORY_BASIC_INFORMATION mbi{};
+
+	for (std::uint64_t uCursor = address; uCursor < uEnd;)
+	{
+		if (!VirtualQueryEx(m_process, reinterpret_cast<LPCVOID>(uCursor), &mbi, sizeof(mbi)))
+			break;
+
+		std::uint64_t uRegionEnd = reinterpret_cast<std::uint64_t>(mbi.BaseAddress) + mbi.RegionSize;
+
+		//
+		// Guard and no access pages are skipped rather than reprotected, they read back as zeroes.
+		if (mbi.State == MEM_COMMIT && mbi.Protect != 0 && (mbi.Protect & (PAGE_NOACCESS | PAGE_GUARD)) == 0)
+			PushRange(vecRanges, uCursor, std::min(uRegionEnd, uEnd));
+
+		uCursor = uRegionEnd;
+	}
+
+	return vecRanges;
+}
+
+std::size_t ProcessMemorySource::ReadRange(std::uint64_t address, void* buffer, std::size_t size) const
+{
+	SIZE_T nRead = 0;
+
+	if (ReadProcessMemory(m_process, reinterpret_cast<LPCVOID>(address), buffer, size, &nRead) && nRead == size)
+		return size;
+
+	//
+	// The protection can change under us, fall back to pages so one bad page doesn't lose the rest.
+	std::size_t nTotal = 0;
+
+	for (std::size_t offset = 0; offset < size;)
+	{
+		std::size_t nChunk = std::min<std::size_t>(pepp::PAGE_SIZE - ((address + offset) & (pepp::PAGE_SIZE - 1)), size - offset);
+
+		if (ReadProcessMemory(m_process, reinterpret_cast<LPCVOID>(address + offset), static_cast<std::uint8_t*>(buffer) + offset, nChunk, &nRead))
+			nTotal += nRead;
+
+		offset += nChunk;
+	}
+
+	return nTotal;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "MemorySource.hpp"
+
+namespace vif
+{
+	///
+	//! class ProcessMemorySource
+	//! A live process, the handle is borrowed and needs PROCESS_QUERY_INFORMATION and PROCESS_VM_READ.
+	///
+	class ProcessMemorySource : public IMemorySource
+	{
+	public:
+		ProcessMemorySource(HANDLE hProcess) noexcept;
+
+		std::vector<MemoryRange_t> QueryRanges(std::uint64_t address, std::size_t size) const final override;
+		std::size_t ReadRange(std::uint64_t address, void* buffer, std::size_t size) const final override;
+
+	private:
+		HANDLE	m_process;
+	};
+}
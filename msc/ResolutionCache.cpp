@@ -0,0 +1,313 @@
+#include "../VMPImportFixer.hpp"
+#include <bit>
+
+using namespace vif;
+
+namespace
+{
+	//! Set on a record that removes its key
+	constexpr std::uint8_t CACHE_RECORD_EVICTED = 1;
+}
+
+std::uint64_t vif::HashBytes(const void* data, std::size_t size, std::uint64_t seed) noexcept
+{
+	constexpr std::uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+	constexpr std::uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+
+	const std::uint8_t* p = static_cast<const std::uint8_t*>(data);
+	std::uint64_t h = seed ^ (size * PRIME1);
+
+	//
+	// A word at a time, sections run into megabytes.
+	for (; size >= sizeof(std::uint64_t); p += sizeof(std::uint64_t), size -= sizeof(std::uint64_t))
+	{
+		std::uint64_t w;
+		std::memcpy(&w, p, sizeof(w));
+
+		h ^= std::rotl(w * PRIME2, 31) * PRIME1;
+		h = std::rotl(h, 27) * PRIME1 + PRIME2;
+	}
+
+	for (; size; ++p, --size)
+	{
+		h ^= *p * PRIME1;
+		h = std::rotl(h, 11) * PRIME2;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME1;
+	h ^= h >> 32;
+	return h;
+}
+
+ResolutionCache::~ResolutionCache()
+{
+	Close();
+}
+
+void ResolutionCache::_unmap() noexcept
+{
+	if (m_view)
+		UnmapViewOfFile(m_view);
+
+	m_view = nullptr;
+	m_mapping = INVALID_HANDLE_VALUE;
+	m_index.clear();
+}
+
+void ResolutionCache::Close() noexcept
+{
+	if (m_file.handle() != INVALID_HANDLE_VALUE)
+		FlushFileBuffers(m_file);
+
+	_unmap();
+	m_strings.clear();
+	m_file = INVALID_HANDLE_VALUE;
+}
+
+bool ResolutionCache::Open(std::string_view path) noexcept
+{
+	LARGE_INTEGER liSize{};
+
+	Close();
+
+	m_file = CreateFileA(std::string(path).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file.handle() == INVALID_HANDLE_VALUE)
+	{
+		//
+		// Records are appended through a single handle, a second writer would tear them.
+		if (GetLastError() == ERROR_SHARING_VIOLATION)
+			logger->warn("The resolution cache {} is in use by another process", path);
+
+		return false;
+	}
+
+	if (!GetFileSizeEx(m_file, &liSize))
+	{
+		Close();
+		return false;
+	}
+
+	//
+	// Records of an older version don't have what entries are checked against now, start the file over.
+	if (liSize.QuadPart >= sizeof(CacheHeader_t))
+	{
+		CacheHeader_t hdr{};
+		DWORD dwRead = 0;
+
+		if (ReadFile(m_file, &hdr, sizeof(hdr), &dwRead, nullptr) && dwRead == sizeof(hdr) &&
+			hdr.magic == CACHE_MAGIC && hdr.version != CACHE_VERSION)
+		{
+			LARGE_INTEGER liZero{};
+
+			logger->info("The resolution cache {} is of version {}, starting it over", path, hdr.version);
+
+			if (!SetFilePointerEx(m_file, liZero, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file))
+			{
+				Close();
+				return false;
+			}
+
+			liSize.QuadPart = 0;
+		}
+	}
+
+	if (liSize.QuadPart == 0)
+	{
+		CacheHeader_t hdr{ CACHE_MAGIC, CACHE_VERSION, 0 };
+		DWORD dwWritten = 0;
+
+		if (!WriteFile(m_file, &hdr, sizeof(hdr), &dwWritten, nullptr) || dwWritten != sizeof(hdr))
+		{
+			Close();
+			return false;
+		}
+
+		liSize.QuadPart = sizeof(hdr);
+	}
+
+	std::uint64_t uValid = _index();
+
+	if (uValid == 0)
+	{
+		Close();
+		return false;
+	}
+
+	//
+	// Whatever follows the last valid record was torn by a crash, cut it off so appends land right after.
+	if (uValid < static_cast<std::uint64_t>(liSize.QuadPart))
+	{
+		LARGE_INTEGER liValid{};
+		liValid.QuadPart = uValid;
+
+		logger->warn("Dropping {} bytes of torn records from the cache", liSize.QuadPart - uValid);
+
+		_unmap();
+
+		if (!SetFilePointerEx(m_file, liValid, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file) || _index() != uValid)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	LARGE_INTEGER liZero{};
+	SetFilePointerEx(m_file, liZero, nullptr, FILE_END);
+	return true;
+}
+
+std::shared_ptr<ResolutionCache> ResolutionCache::Acquire(std::string_view path)
+{
+	static std::mutex s_lock;
+	static std::map<std::string, std::weak_ptr<ResolutionCache>> s_caches;
+
+	//
+	// Paths are compared the way the file system would, the same file can be named in more than one way.
+	std::error_code ec;
+	std::string sKey = std::filesystem::weakly_canonical(std::filesystem::path(path), ec).string();
+
+	if (ec)
+		sKey = std::string(path);
+
+	std::transform(sKey.begin(), sKey.end(), sKey.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	std::lock_guard lock(s_lock);
+	std::weak_ptr<ResolutionCache>& wpCache = s_caches[sKey];
+
+	if (auto pCache = wpCache.lock())
+		return pCache;
+
+	auto pCache = std::make_shared<ResolutionCache>();
+
+	if (!pCache->Open(path))
+		return nullptr;
+
+	wpCache = pCache;
+	return pCache;
+}
+
+std::uint64_t ResolutionCache::_index() noexcept
+{
+	LARGE_INTEGER liSize{};
+
+	if (!GetFileSizeEx(m_file, &liSize) || liSize.QuadPart < sizeof(CacheHeader_t))
+		return 0;
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping.handle() == INVALID_HANDLE_VALUE)
+		return 0;
+
+	m_view = static_cast<const std::uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_view == nullptr)
+		return 0;
+
+	const CacheHeader_t* pHeader = reinterpret_cast<const CacheHeader_t*>(m_view);
+
+	if (pHeader->magic != CACHE_MAGIC || pHeader->version != CACHE_VERSION)
+		return 0;
+
+	std::uint64_t uSize = liSize.QuadPart;
+	std::uint64_t uOffset = sizeof(CacheHeader_t);
+
+	while (uOffset + sizeof(CacheRecord_t) <= uSize)
+	{
+		CacheRecord_t rec;
+		std::memcpy(&rec, m_view + uOffset, sizeof(rec));
+
+		std::uint64_t uLength = sizeof(rec) + rec.module_length + rec.name_length;
+
+		if (uOffset + uLength > uSize ||
+			HashBytes(m_view + uOffset + sizeof(rec.checksum), static_cast<std::size_t>(uLength - sizeof(rec.checksum))) != rec.checksum)
+			break;
+
+		CacheKey_t key{ rec.image_hash, rec.section_hash, rec.stub_rva, rec.variant };
+
+		if (rec.flags & CACHE_RECORD_EVICTED)
+		{
+			m_index.erase(key);
+		}
+		else
+		{
+			const char* pNames = reinterpret_cast<const char*>(m_view + uOffset + sizeof(rec));
+
+			m_index.insert_or_assign(key, CacheEntry_t{
+				std::string_view(pNames, rec.module_length),
+				std::string_view(pNames + rec.module_length, rec.name_length),
+				rec.ordinal,
+				rec.export_rva });
+		}
+
+		uOffset += uLength;
+	}
+
+	return uOffset;
+}
+
+std::optional<CacheEntry_t> ResolutionCache::Find(const CacheKey_t& key) const noexcept
+{
+	std::lock_guard lock(m_lock);
+
+	auto it = m_index.find(key);
+	if (it == m_index.end())
+		return std::nullopt;
+
+	return it->second;
+}
+
+bool ResolutionCache::_append(const CacheKey_t& key, std::uint8_t flags, std::string_view module_name, std::string_view export_name, std::uint16_t ordinal, std::uint32_t export_rva)
+{
+	if (module_name.size() > 0xffff || export_name.size() > 0xffff)
+		return false;
+
+	CacheRecord_t rec{};
+	rec.image_hash = key.image_hash;
+	rec.section_hash = key.section_hash;
+	rec.stub_rva = key.stub_rva;
+	rec.variant = key.variant;
+	rec.flags = flags;
+	rec.ordinal = ordinal;
+	rec.export_rva = export_rva;
+	rec.module_length = static_cast<std::uint16_t>(module_name.size());
+	rec.name_length = static_cast<std::uint16_t>(export_name.size());
+
+	std::vector<std::uint8_t> vecRecord(sizeof(rec) + module_name.size() + export_name.size());
+	std::memcpy(vecRecord.data() + sizeof(rec), module_name.data(), module_name.size());
+	std::memcpy(vecRecord.data() + sizeof(rec) + module_name.size(), export_name.data(), export_name.size());
+	std::memcpy(vecRecord.data(), &rec, sizeof(rec));
+
+	rec.checksum = HashBytes(vecRecord.data() + sizeof(rec.checksum), vecRecord.size() - sizeof(rec.checksum));
+	std::memcpy(vecRecord.data(), &rec.checksum, sizeof(rec.checksum));
+
+	//
+	// One write per record, a crash can only ever tear the last one.
+	DWORD dwWritten = 0;
+
+	return WriteFile(m_file, vecRecord.data(), static_cast<DWORD>(vecRecord.size()), &dwWritten, nullptr) && dwWritten == vecRecord.size();
+}
+
+bool ResolutionCache::Add(const CacheKey_t& key, std::string_view module_name, std::string_view export_name, std::uint16_t ordinal, std::uint32_t export_rva)
+{
+	std::lock_guard lock(m_lock);
+
+	if (!_append(key, 0, module_name, export_name, ordinal, export_rva))
+		return false;
+
+	std::string_view sModule = m_strings.emplace_back(module_name);
+	std::string_view sExport = m_strings.emplace_back(export_name);
+
+	m_index.insert_or_assign(key, CacheEntry_t{ sModule, sExport, ordinal, export_rva });
+	return true;
+}
+
+bool ResolutionCache::Evict(const CacheKey_t& key)
+{
+	std::lock_guard lock(m_lock);
+
+	if (m_index.erase(key) == 0)
+		return false;
+
+	return _append(key, CACHE_RECORD_EVICTED, {}, {}, 0, 0);
+}
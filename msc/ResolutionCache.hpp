@@ -0,0 +1,132 @@
+#pragma once
+
+#include <pepp/misc/NonCopyable.hpp>
+#include "ScopedHandle.hpp"
+
+namespace vif
+{
+	//! "VIFC"
+	static constexpr std::uint32_t CACHE_MAGIC = 'CFIV';
+	static constexpr std::uint16_t CACHE_VERSION = 2;
+
+	//
+	// On-disk layout:
+	//   CacheHeader_t
+	//   CacheRecord_t, followed by the module name then the export name (not null terminated), repeated.
+	// Records are only ever appended. A later record for the same key replaces an earlier one, and an
+	// evicted record (no names) removes it. A torn record at the end is cut off the next time the file is opened.
+	#pragma pack(push, 1)
+	struct CacheHeader_t
+	{
+		std::uint32_t magic;
+		std::uint16_t version;
+		std::uint16_t reserved;
+	};
+
+	struct CacheRecord_t
+	{
+		//! Of the record and everything in it, except the checksum itself
+		std::uint64_t checksum;
+		std::uint64_t image_hash;
+		std::uint64_t section_hash;
+		std::uint32_t stub_rva;
+		std::uint8_t  variant;
+		std::uint8_t  flags;
+		std::uint16_t ordinal;
+		std::uint32_t export_rva;
+		std::uint16_t module_length;
+		std::uint16_t name_length;
+	};
+	#pragma pack(pop)
+
+	//! What a cached stub is identified by
+	struct CacheKey_t
+	{
+		std::uint64_t image_hash;
+		std::uint64_t section_hash;
+		std::uint32_t stub_rva;
+		std::uint8_t  variant;
+
+		bool operator==(const CacheKey_t&) const = default;
+	};
+
+	//! What a stub resolved to
+	struct CacheEntry_t
+	{
+		std::string_view module_name;
+		//! Empty if the export has no name, it is then found by ordinal.
+		std::string_view export_name;
+		std::uint16_t    ordinal;
+		//! Where the export was, a module that moved it since is a different build.
+		std::uint32_t    export_rva;
+	};
+
+	//! 64bit hash of a buffer, used for both the image identity and the record checksums.
+	std::uint64_t HashBytes(const void* data, std::size_t size, std::uint64_t seed = 0) noexcept;
+
+	///
+	//! class ResolutionCache
+	//! Stub resolutions kept across runs. Lookups read straight out of the mapped file,
+	//! new results are appended one record per write.
+	///
+	class ResolutionCache : pepp::msc::NonCopyable
+	{
+	public:
+		ResolutionCache() = default;
+		~ResolutionCache();
+
+		//! Open (or create) a cache file and index the records in it.
+		//! - returns false if it can't be opened or isn't a cache file.
+		//! - The file is only shared for reading, use Acquire() for a cache several fixers in one process use at once.
+		bool Open(std::string_view path) noexcept;
+
+		//! The cache of a file, shared by everyone in the process that has it open. Opened by the first one.
+		//! - returns nullptr if it can't be opened or isn't a cache file.
+		static std::shared_ptr<ResolutionCache> Acquire(std::string_view path);
+
+		//! Flush and close the file
+		void Close() noexcept;
+
+		bool IsOpen() noexcept {
+			return m_file.handle() != INVALID_HANDLE_VALUE;
+		}
+
+		//! Find a cached result, names point into the mapped file (or into results added since it was opened).
+		std::optional<CacheEntry_t> Find(const CacheKey_t& key) const noexcept;
+
+		//! Record a result, it is written out right away.
+		bool Add(const CacheKey_t& key, std::string_view module_name, std::string_view export_name, std::uint16_t ordinal, std::uint32_t export_rva);
+
+		//! Drop a result that no longer holds, e.g the module changed and the export is gone.
+		bool Evict(const CacheKey_t& key);
+
+		std::size_t size() const noexcept {
+			return m_index.size();
+		}
+
+	private:
+		struct KeyHash_t
+		{
+			std::size_t operator()(const CacheKey_t& key) const noexcept {
+				return static_cast<std::size_t>(key.image_hash ^ (key.section_hash * 31) ^ (std::uint64_t(key.stub_rva) << 8) ^ key.variant);
+			}
+		};
+
+		//! Map the file and index every valid record
+		//! - returns the length of the valid part of the file.
+		std::uint64_t _index() noexcept;
+
+		//! Append a single record
+		bool _append(const CacheKey_t& key, std::uint8_t flags, std::string_view module_name, std::string_view export_name, std::uint16_t ordinal, std::uint32_t export_rva);
+
+		void _unmap() noexcept;
+
+		nt::ScopedHandle										m_file;
+		nt::ScopedHandle										m_mapping;
+		const std::uint8_t*										m_view = nullptr;
+		std::unordered_map<CacheKey_t, CacheEntry_t, KeyHash_t>	m_index;
+		//! Names of records added since the file was mapped
+		std::deque<std::string>									m_strings;
+		mutable std::mutex										m_lock;
+	};
+}
@@ -0,0 +1,379 @@
+#include "../VMPImportFixer.hpp"
+
+using namespace vif;
+
+Snapshot::~Snapshot()
+{
+	Close();
+}
+
+void Snapshot::Close() noexcept
+{
+	if (m_view)
+		UnmapViewOfFile(m_view);
+
+	m_view = nullptr;
+	m_header = nullptr;
+	m_modules = nullptr;
+	m_size = 0;
+	m_mapping = INVALID_HANDLE_VALUE;
+	m_file = INVALID_HANDLE_VALUE;
+}
+
+bool Snapshot::Open(std::string_view path) noexcept
+{
+	LARGE_INTEGER liSize{};
+
+	Close();
+
+	m_file = CreateFileA(std::string(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (m_file.handle() == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (!GetFileSizeEx(m_file, &liSize) || liSize.QuadPart < static_cast<LONGLONG>(sizeof(SnapshotHeader_t)))
+		return false;
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping.handle() == INVALID_HANDLE_VALUE)
+		return false;
+
+	m_view = static_cast<const std::uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_view == nullptr)
+		return false;
+
+	m_size = liSize.QuadPart;
+	m_header = reinterpret_cast<const SnapshotHeader_t*>(m_view);
+
+	if (m_header->magic != SNAPSHOT_MAGIC || m_header->version != SNAPSHOT_VERSION)
+	{
+		Close();
+		return false;
+	}
+
+	if (sizeof(SnapshotHeader_t) + (std::uint64_t)m_header->module_count * sizeof(SnapshotModule_t) > m_size)
+	{
+		Close();
+		return false;
+	}
+
+	m_modules = reinterpret_cast<const SnapshotModule_t*>(m_view + sizeof(SnapshotHeader_t));
+
+	//
+	// Validate every module lies inside of the file, so lookups don't need to. Offsets are checked
+	// against what is left of the file, a crafted offset can't wrap around.
+	for (std::uint32_t i = 0; i < m_header->module_count; ++i)
+	{
+		const SnapshotModule_t& mod = m_modules[i];
+
+		if (mod.path_offset > m_size || mod.path_length > m_size - mod.path_offset ||
+			mod.data_offset > m_size || mod.module_size > m_size - mod.data_offset)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Snapshot::IsSnapshotFile(std::string_view path) noexcept
+{
+	SnapshotHeader_t hdr{};
+	std::ifstream file(std::string(path), std::ios::binary);
+
+	if (!file.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)))
+		return false;
+
+	return hdr.magic == SNAPSHOT_MAGIC;
+}
+
+VIFModuleInformation_t Snapshot::GetModuleInformation(std::uint32_t idx) const
+{
+	if (idx >= GetModuleCount())
+		return {};
+
+	const SnapshotModule_t& mod = m_modules[idx];
+
+	return
+	{
+		std::string(reinterpret_cast<const char*>(m_view + mod.path_offset), mod.path_length),
+		mod.base_address,
+		mod.module_size
+	};
+}
+
+const std::uint8_t* Snapshot::GetModuleData(std::uint32_t idx) const noexcept
+{
+	if (idx >= GetModuleCount())
+		return nullptr;
+
+	return m_view + m_modules[idx].data_offset;
+}
+
+namespace
+{
+	//! Check the headers at the start of an image, file or memory layout alike.
+	//! - returns the NT headers (FileHeader sits at the same place for both bitsizes), nullptr if they aren't valid.
+	const IMAGE_NT_HEADERS32* ReadImageHeaders(const std::vector<std::uint8_t>& data, std::uint16_t& bitsize, std::uint64_t& image_base,
+		std::uint32_t& size_of_image, std::uint32_t& size_of_headers)
+	{
+		if (data.size() < sizeof(IMAGE_DOS_HEADER))
+			return nullptr;
+
+		auto* pDosHdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(data.data());
+
+		if (pDosHdr->e_magic != IMAGE_DOS_SIGNATURE || pDosHdr->e_lfanew <= 0 ||
+			pDosHdr->e_lfanew + sizeof(IMAGE_NT_HEADERS64) > data.size())
+			return nullptr;
+
+		//
+		// The optional header differs between bitsizes.
+		auto* pNtHdr32 = reinterpret_cast<const IMAGE_NT_HEADERS32*>(data.data() + pDosHdr->e_lfanew);
+		auto* pNtHdr64 = reinterpret_cast<const IMAGE_NT_HEADERS64*>(data.data() + pDosHdr->e_lfanew);
+
+		if (pNtHdr32->Signature != IMAGE_NT_SIGNATURE)
+			return nullptr;
+
+		if (pNtHdr32->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+		{
+			bitsize = 32;
+			image_base = pNtHdr32->OptionalHeader.ImageBase;
+			size_of_image = pNtHdr32->OptionalHeader.SizeOfImage;
+			size_of_headers = pNtHdr32->OptionalHeader.SizeOfHeaders;
+		}
+		else if (pNtHdr64->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+		{
+			bitsize = 64;
+			image_base = pNtHdr64->OptionalHeader.ImageBase;
+			size_of_image = pNtHdr64->OptionalHeader.SizeOfImage;
+			size_of_headers = pNtHdr64->OptionalHeader.SizeOfHeaders;
+		}
+		else
+		{
+			return nullptr;
+		}
+
+		if (size_of_image == 0 || size_of_headers > size_of_image)
+			return nullptr;
+
+		return pNtHdr32;
+	}
+
+	//! Lay an image file out the way the loader would, sections at their virtual addresses.
+	//! Nothing is relocated and no imports are bound.
+	bool MapImageFile(const std::string& file, std::vector<std::uint8_t>& mapped, std::uint16_t& bitsize, std::uint64_t& image_base)
+	{
+		std::ifstream stream(file, std::ios::binary);
+		std::vector<std::uint8_t> vecFile((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		std::uint32_t uSizeOfImage, uSizeOfHeaders;
+
+		const IMAGE_NT_HEADERS32* pNtHdr32 = ReadImageHeaders(vecFile, bitsize, image_base, uSizeOfImage, uSizeOfHeaders);
+		if (pNtHdr32 == nullptr)
+			return false;
+
+		mapped.assign(pepp::Align4kb(uSizeOfImage - 1), 0);
+		std::memcpy(mapped.data(), vecFile.data(), std::min<std::size_t>({ uSizeOfHeaders, vecFile.size(), mapped.size() }));
+
+		auto* pSections = IMAGE_FIRST_SECTION(pNtHdr32);
+
+		for (std::uint16_t i = 0; i < pNtHdr32->FileHeader.NumberOfSections; ++i)
+		{
+			const IMAGE_SECTION_HEADER& sec = pSections[i];
+
+			if (reinterpret_cast<const std::uint8_t*>(&sec + 1) > vecFile.data() + vecFile.size())
+				return false;
+
+			std::uint64_t uSize = std::min<std::uint64_t>(sec.SizeOfRawData, sec.Misc.VirtualSize ? sec.Misc.VirtualSize : sec.SizeOfRawData);
+
+			uSize = std::min<std::uint64_t>(uSize, vecFile.size() > sec.PointerToRawData ? vecFile.size() - sec.PointerToRawData : 0);
+			uSize = std::min<std::uint64_t>(uSize, mapped.size() > sec.VirtualAddress ? mapped.size() - sec.VirtualAddress : 0);
+
+			std::memcpy(&mapped[sec.VirtualAddress], &vecFile[sec.PointerToRawData], static_cast<std::size_t>(uSize));
+		}
+
+		return true;
+	}
+}
+
+bool Snapshot::_write(std::string_view path, std::uint16_t bitsize, const std::vector<VIFModuleInformation_t>& modules, const IMemorySource& source)
+{
+	std::vector<SnapshotModule_t> vecEntries;
+
+	SnapshotHeader_t hdr{};
+	hdr.magic = SNAPSHOT_MAGIC;
+	hdr.version = SNAPSHOT_VERSION;
+	hdr.bitsize = bitsize;
+	hdr.module_count = static_cast<std::uint32_t>(modules.size());
+
+	//
+	// Lay out the table, paths then the page aligned module data.
+	std::uint64_t uOffset = sizeof(hdr) + modules.size() * sizeof(SnapshotModule_t);
+
+	for (auto& mod : modules)
+	{
+		SnapshotModule_t entry{};
+		entry.base_address = mod.base_address;
+		entry.module_size = mod.module_size;
+		entry.path_length = static_cast<std::uint32_t>(mod.module_path.size());
+		entry.path_offset = uOffset;
+
+		uOffset += entry.path_length;
+		vecEntries.push_back(entry);
+	}
+
+	//
+	// pepp::Align only aligns 32bit wide, the data of a large process runs well past 4gb.
+	for (auto& entry : vecEntries)
+	{
+		uOffset = (uOffset + pepp::PAGE_SIZE - 1) & ~static_cast<std::uint64_t>(pepp::PAGE_SIZE - 1);
+		entry.data_offset = uOffset;
+		uOffset += entry.module_size;
+	}
+
+	std::ofstream file(std::string(path), std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+	file.write(reinterpret_cast<const char*>(vecEntries.data()), vecEntries.size() * sizeof(SnapshotModule_t));
+
+	for (auto& mod : modules)
+		file.write(mod.module_path.data(), mod.module_path.size());
+
+	//
+	// Stream each module out, only one module buffer is alive at a time.
+	for (std::size_t i = 0; i < modules.size(); ++i)
+	{
+		std::unique_ptr<std::uint8_t[]> pModBuffer(new std::uint8_t[modules[i].module_size]{});
+
+		VifReadModule(source, modules[i], pModBuffer.get());
+
+		file.seekp(vecEntries[i].data_offset);
+		file.write(reinterpret_cast<const char*>(pModBuffer.get()), modules[i].module_size);
+
+		logger->info("Captured module {} located @ 0x{:X}", modules[i].module_path, modules[i].base_address);
+	}
+
+	return file.good();
+}
+
+bool Snapshot::Capture(HANDLE hProcess, std::string_view path)
+{
+	std::vector<VIFModuleInformation_t> vecModules;
+	ProcessMemorySource source(hProcess);
+	BOOL bIsWow64 = FALSE;
+
+	if (!VifFindModulesInProcess(hProcess, vecModules))
+		return false;
+
+	IsWow64Process(hProcess, &bIsWow64);
+
+	return _write(path, bIsWow64 ? 32 : 64, vecModules, source);
+}
+
+bool Snapshot::CaptureImages(const std::vector<std::string>& files, std::string_view path)
+{
+	std::vector<VIFModuleInformation_t> vecModules;
+	std::vector<std::vector<std::uint8_t>> vecMapped(files.size());
+	AddressSpaceMap<std::size_t> mRanges;
+	BufferMemorySource source;
+	std::uint16_t uBitSize = 0;
+
+	for (std::size_t i = 0; i < files.size(); ++i)
+	{
+		std::uint16_t uImageBitSize = 0;
+		std::uint64_t uBase = 0;
+
+		if (!MapImageFile(files[i], vecMapped[i], uImageBitSize, uBase))
+		{
+			logger->critical("Unable to map image file {}", files[i]);
+			return false;
+		}
+
+		if (uBitSize != 0 && uImageBitSize != uBitSize)
+		{
+			logger->critical("{} is {}bit, the images before it are {}bit", files[i], uImageBitSize, uBitSize);
+			return false;
+		}
+
+		uBitSize = uImageBitSize;
+
+		//
+		// Images wanting the same base get moved, like the loader would (minus the relocations).
+		if (!mRanges.Insert(uBase, vecMapped[i].size(), i))
+		{
+			std::uint64_t uPreferred = uBase;
+
+			uBase = mRanges.FindGap(vecMapped[i].size(), uPreferred, 0x10000);
+			if (uBase == 0 || !mRanges.Insert(uBase, vecMapped[i].size(), i))
+			{
+				logger->critical("Unable to find room for {}", files[i]);
+				return false;
+			}
+
+			logger->warn("{} moved from 0x{:X} to 0x{:X}, it is not relocated", files[i], uPreferred, uBase);
+		}
+
+		//
+		// The loader writes the actual base into the headers, and the fixer reads it from there.
+		auto* pDosHdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(vecMapped[i].data());
+
+		if (uBitSize == 32)
+			reinterpret_cast<IMAGE_NT_HEADERS32*>(vecMapped[i].data() + pDosHdr->e_lfanew)->OptionalHeader.ImageBase = static_cast<DWORD>(uBase);
+		else
+			reinterpret_cast<IMAGE_NT_HEADERS64*>(vecMapped[i].data() + pDosHdr->e_lfanew)->OptionalHeader.ImageBase = uBase;
+
+		source.AddRange(uBase, vecMapped[i].data(), vecMapped[i].size());
+		vecModules.push_back({ std::filesystem::absolute(files[i]).string(), uBase, static_cast<std::uint32_t>(vecMapped[i].size()) });
+	}
+
+	return _write(path, uBitSize, vecModules, source);
+}
+
+bool Snapshot::CaptureDumps(const std::vector<std::string>& files, std::string_view path)
+{
+	std::vector<VIFModuleInformation_t> vecModules;
+	FileMemorySource source;
+	std::uint16_t uBitSize = 0;
+
+	for (auto& file : files)
+	{
+		//
+		// Only the headers are read here, the rest goes straight from the dump into the snapshot.
+		std::ifstream stream(file, std::ios::binary);
+		std::vector<std::uint8_t> vecHeaders(pepp::PAGE_SIZE);
+		std::uint16_t uDumpBitSize = 0;
+		std::uint64_t uBase = 0;
+		std::uint32_t uSizeOfImage, uSizeOfHeaders;
+
+		stream.read(reinterpret_cast<char*>(vecHeaders.data()), static_cast<std::streamsize>(vecHeaders.size()));
+		vecHeaders.resize(static_cast<std::size_t>(stream.gcount()));
+
+		if (ReadImageHeaders(vecHeaders, uDumpBitSize, uBase, uSizeOfImage, uSizeOfHeaders) == nullptr)
+		{
+			logger->critical("{} is not a memory dump of an image", file);
+			return false;
+		}
+
+		if (uBitSize != 0 && uDumpBitSize != uBitSize)
+		{
+			logger->critical("{} is {}bit, the dumps before it are {}bit", file, uDumpBitSize, uBitSize);
+			return false;
+		}
+
+		uBitSize = uDumpBitSize;
+
+		//
+		// The loader wrote the base the module ended up at into its headers. Past the end of a short dump
+		// the module reads as zeroes.
+		if (!source.AddFile(file, uBase))
+		{
+			logger->critical("Unable to add {} at 0x{:X}, it can't be read or overlaps a dump before it", file, uBase);
+			return false;
+		}
+
+		vecModules.push_back({ std::filesystem::absolute(file).string(), uBase, uSizeOfImage });
+	}
+
+	return _write(path, uBitSize, vecModules, source);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <pepp/misc/NonCopyable.hpp>
+#include "ScopedHandle.hpp"
+
+namespace vif
+{
+	//! "VIFS"
+	static constexpr std::uint32_t SNAPSHOT_MAGIC = 'SFIV';
+	static constexpr std::uint16_t SNAPSHOT_VERSION = 1;
+
+	//
+	// On-disk layout:
+	//   SnapshotHeader_t
+	//   SnapshotModule_t[module_count]
+	//   module paths (not null terminated)
+	//   module data, each blob aligned to a page so views can be handed out as-is.
+	#pragma pack(push, 1)
+	struct SnapshotHeader_t
+	{
+		std::uint32_t magic;
+		std::uint16_t version;
+		std::uint16_t bitsize;
+		std::uint32_t module_count;
+		std::uint32_t reserved;
+	};
+
+	struct SnapshotModule_t
+	{
+		std::uint64_t base_address;
+		std::uint32_t module_size;
+		std::uint32_t path_length;
+		std::uint64_t path_offset;
+		std::uint64_t data_offset;
+	};
+	#pragma pack(pop)
+
+	///
+	//! class Snapshot
+	//! Read-only, memory mapped view of a captured process.
+	///
+	class Snapshot : pepp::msc::NonCopyable
+	{
+	public:
+		Snapshot() = default;
+		~Snapshot();
+
+		//! Map a snapshot file
+		//! - returns false if the file is not a valid snapshot.
+		bool Open(std::string_view path) noexcept;
+
+		//! Unmap the view
+		void Close() noexcept;
+
+		//! Check the magic of a file without mapping it.
+		static bool IsSnapshotFile(std::string_view path) noexcept;
+
+		//! Capture all modules of a process into a snapshot file.
+		static bool Capture(HANDLE hProcess, std::string_view path);
+
+		//! Build a snapshot out of image files on disk instead of a process, the first one is the main module.
+		//! - Images are laid out at their preferred base (or moved if taken) but not relocated, and imports aren't bound.
+		static bool CaptureImages(const std::vector<std::string>& files, std::string_view path);
+
+		//! Build a snapshot out of raw memory dumps of modules, as they were laid out in a process. The first one
+		//! is the main module, each goes at the base its headers name.
+		static bool CaptureDumps(const std::vector<std::string>& files, std::string_view path);
+
+		std::uint16_t GetBitSize() const noexcept {
+			return m_header ? m_header->bitsize : 0;
+		}
+
+		std::uint32_t GetModuleCount() const noexcept {
+			return m_header ? m_header->module_count : 0;
+		}
+
+		//! Get the module information
+		VIFModuleInformation_t GetModuleInformation(std::uint32_t idx) const;
+
+		//! Get a pointer to the module bytes inside of the view.
+		const std::uint8_t* GetModuleData(std::uint32_t idx) const noexcept;
+
+	private:
+		//! Write out the modules, as read from `source`
+		static bool _write(std::string_view path, std::uint16_t bitsize, const std::vector<VIFModuleInformation_t>& modules, const IMemorySource& source);
+
+		nt::ScopedHandle			m_file;
+		nt::ScopedHandle			m_mapping;
+		const std::uint8_t*			m_view = nullptr;
+		std::uint64_t				m_size = 0;
+		const SnapshotHeader_t*		m_header = nullptr;
+		const SnapshotModule_t*		m_modules = nullptr;
+	};
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+//
+// Shared by the benchmarks, which are plain executables printing one line per measurement.
+namespace vif::bench
+{
+	//! Wall time of the fastest of `runs` calls of `fn`, in seconds.
+	template<typename Fn>
+	double BestOf(std::size_t runs, Fn&& fn)
+	{
+		double dBest = 0.0;
+
+		for (std::size_t i = 0; i < runs; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			double dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			if (i == 0 || dElapsed < dBest)
+				dBest = dElapsed;
+		}
+
+		return dBest;
+	}
+
+	//! Peak resident set of the process so far, in MB.
+	inline double PeakRssMb()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS pmc{};
+
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+			return 0.0;
+
+		return static_cast<double>(pmc.PeakWorkingSetSize) / (1024.0 * 1024.0);
+#else
+		rusage usage{};
+
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0.0;
+
+		//
+		// ru_maxrss is in kilobytes on Linux, bytes on macOS.
+#ifdef __APPLE__
+		return static_cast<double>(usage.ru_maxrss) / (1024.0 * 1024.0);
+#else
+		return static_cast<double>(usage.ru_maxrss) / 1024.0;
+#endif
+#endif
+	}
+
+	//! Small, fast and the same everywhere, so generated inputs don't depend on the standard library.
+	class XorShift
+	{
+	public:
+		explicit XorShift(std::uint64_t seed) noexcept
+			: m_state(seed ? seed : 0x9E3779B97F4A7C15ull)
+		{
+		}
+
+		std::uint64_t Next() noexcept
+		{
+			m_state ^= m_state << 13;
+			m_state ^= m_state >> 7;
+			m_state ^= m_state << 17;
+			return m_state;
+		}
+
+		//! Uniform in [0, bound)
+		std::uint64_t Below(std::uint64_t bound) noexcept {
+			return Next() % bound;
+		}
+
+	private:
+		std::uint64_t m_state;
+	};
+}
@@ -0,0 +1,114 @@
+#include <pepp/misc/BytePattern.hpp>
+#include <gtest/gtest.h>
+#include "Bench.hpp"
+
+using namespace pepp;
+
+namespace
+{
+	//! Every non-overlapping match, one offset at a time. What the scanner has to agree with.
+	std::vector<PatternMatch_t> ScanNaive(const std::vector<std::uint8_t>& data, std::span<const BytePattern> patterns)
+	{
+		std::vector<PatternMatch_t> matches;
+
+		for (std::size_t pos = 0; pos < data.size();)
+		{
+			bool bMatched = false;
+
+			for (std::size_t k = 0; k < patterns.size() && !bMatched; ++k)
+			{
+				if (patterns[k].size() <= data.size() - pos && patterns[k].Matches(data.data() + pos))
+				{
+					matches.push_back({ k, static_cast<std::uint32_t>(pos) });
+					pos += patterns[k].size();
+					bMatched = true;
+				}
+			}
+
+			if (!bMatched)
+				++pos;
+		}
+
+		return matches;
+	}
+
+	std::vector<std::uint8_t> MakeCode(std::size_t size, std::uint64_t seed)
+	{
+		vif::bench::XorShift rng(seed);
+		std::vector<std::uint8_t> vecData(size);
+
+		//
+		// Plenty of E8 and FF bytes, so candidates are dense.
+		for (auto& b : vecData)
+			b = static_cast<std::uint8_t>(rng.Below(4) == 0 ? (rng.Below(2) ? 0xe8 : 0xff) : rng.Next());
+
+		return vecData;
+	}
+}
+
+TEST(BytePattern, Compiles)
+{
+	constexpr BytePattern pattern("E8 ? ? ?? 0F");
+
+	static_assert(pattern.valid());
+	static_assert(pattern.size() == 5);
+	static_assert(pattern.IsWildcard(1) && pattern.IsWildcard(3) && !pattern.IsWildcard(4));
+	static_assert(pattern.HasAnchor() && pattern.GetAnchor() == 0);
+
+	EXPECT_FALSE(BytePattern("E8 ? G0").valid());
+	EXPECT_FALSE(BytePattern("E").valid());
+	EXPECT_FALSE(BytePattern("").valid());
+	EXPECT_FALSE(BytePattern("? ?").HasAnchor());
+}
+
+TEST(BytePattern, FindsMatchesAtEitherEnd)
+{
+	std::vector<std::uint8_t> vecData(100, 0x90);
+	BytePattern pattern("E8 ? ? ? ?");
+
+	vecData[0] = 0xe8;
+	vecData[95] = 0xe8;
+	vecData[97] = 0xe8;
+
+	//
+	// The last E8 has no room for its operand, it must not be matched or read past.
+	EXPECT_EQ(ScanPattern(vecData.data(), vecData.size(), pattern), (std::vector<std::uint32_t>{ 0, 95 }));
+}
+
+TEST(BytePattern, SingleScanMatchesNaiveScan)
+{
+	auto vecData = MakeCode(0x10000 + 13, 1);
+	std::array<BytePattern, 1> patterns{ BytePattern("E8 ? ? ? ?") };
+
+	auto vecOffsets = ScanPattern(vecData.data(), vecData.size(), patterns[0]);
+	auto vecExpected = ScanNaive(vecData, patterns);
+
+	ASSERT_EQ(vecOffsets.size(), vecExpected.size());
+
+	for (std::size_t i = 0; i < vecOffsets.size(); ++i)
+		EXPECT_EQ(vecOffsets[i], vecExpected[i].offset);
+}
+
+TEST(BytePattern, MultiScanMatchesNaiveScan)
+{
+	auto vecData = MakeCode(0x10000 + 29, 2);
+	std::array<BytePattern, 3> patterns{ BytePattern("FF 15 ? ? ? ?"), BytePattern("E8 ? ? ? ? C3"), BytePattern("? FF E8") };
+
+	auto vecMatches = ScanPatterns(vecData.data(), vecData.size(), patterns);
+	auto vecExpected = ScanNaive(vecData, patterns);
+
+	ASSERT_EQ(vecMatches.size(), vecExpected.size());
+
+	for (std::size_t i = 0; i < vecMatches.size(); ++i)
+	{
+		EXPECT_EQ(vecMatches[i].offset, vecExpected[i].offset);
+		EXPECT_EQ(vecMatches[i].index, vecExpected[i].index);
+	}
+}
+
+TEST(BytePattern, AllWildcardsMatchEverywhere)
+{
+	std::vector<std::uint8_t> vecData(10, 0);
+
+	EXPECT_EQ(ScanPattern(vecData.data(), vecData.size(), BytePattern("? ?")).size(), 5u);
+}
@@ -0,0 +1,129 @@
+#include "PeCorpus.hpp"
+#include <cstdlib>
+#include <string>
+#include "Bench.hpp"
+#ifdef VIF_HAVE_MICRO_EMULATOR
+#include <VIFMicroEmulator.hpp>
+#endif
+
+//
+// The fixer's portable phases over synthetic corpora of 1k, 10k and 100k call sites: finding the calls,
+// and (with Zydis) resolving every stub with the micro emulator. Each result is checked against what the
+// generator wrote, any difference fails the run. The full fixer runs on Windows only, PipelineBench.cpp
+// runs it end to end over the same images.
+namespace
+{
+	constexpr std::size_t SITE_COUNTS[] = { 1000, 10000, 100000 };
+	constexpr std::size_t RUNS = 3;
+
+#ifdef VIF_HAVE_MICRO_EMULATOR
+	//! Returns the number of stubs that didn't leave for their import.
+	std::ptrdiff_t ResolveStubs(const vif::corpus::Corpus_t& corpus, double& seconds)
+	{
+		constexpr std::uint64_t STACK_BASE = 0x100000;
+		constexpr std::uint64_t STACK_SIZE = 0x10000;
+
+		ZydisDecoder decoder;
+		bool b64 = corpus.bitsize == 64;
+
+		ZydisDecoderInit(&decoder, b64 ? ZYDIS_MACHINE_MODE_LONG_64 : ZYDIS_MACHINE_MODE_LONG_COMPAT_32, b64 ? ZYDIS_ADDRESS_WIDTH_64 : ZYDIS_ADDRESS_WIDTH_32);
+
+		std::vector<VifMemoryRegion_t> vecRegions{
+			{ corpus.target.base, corpus.target.mapped.size(), corpus.target.mapped.data(), UC_PROT_READ | UC_PROT_EXEC },
+			{ corpus.dependency.base, corpus.dependency.mapped.size(), corpus.dependency.mapped.data(), UC_PROT_READ }
+		};
+
+		std::ptrdiff_t nMismatches = 0;
+
+		auto Run = [&]<size_t BitSize>()
+		{
+			VifMicroEmulator<BitSize> micro(&decoder);
+
+			micro.Initialize(&vecRegions, nullptr, STACK_BASE, STACK_SIZE, (STACK_BASE + STACK_SIZE - 0x1000) & ~0xfull);
+			nMismatches = 0;
+
+			for (auto& call : corpus.calls)
+			{
+				VifStubJob_t job{ corpus.target.base + call.stub, corpus.target.base + call.rva + 5,
+					corpus.target.base, corpus.target.base + corpus.target.mapped.size() };
+				std::uint64_t uExit = 0;
+
+				if (!micro.Run(job, VifMicroEmulator<BitSize>::MAX_INSTRUCTIONS, uExit) || uExit != call.import)
+					++nMismatches;
+			}
+		};
+
+		seconds = vif::bench::BestOf(RUNS, [&]
+			{
+				if (b64)
+					Run.template operator()<64>();
+				else
+					Run.template operator()<32>();
+			});
+
+		return nMismatches;
+	}
+#endif
+}
+
+int main()
+{
+	bool bFailed = false;
+
+	std::printf("%-6s %8s %11s %9s %13s %11s %11s %9s\n", "format", "sites", "generate ms", "scan ms", "sites/s", "emulate ms", "stubs/s", "peak MB");
+
+	for (std::size_t bitsize : { 32, 64 })
+	{
+		for (std::size_t nSites : SITE_COUNTS)
+		{
+			vif::corpus::CorpusOptions_t options{};
+			vif::corpus::Corpus_t corpus;
+
+			options.bitsize = bitsize;
+			options.call_sites = nSites;
+
+			double dGenerate = vif::bench::BestOf(1, [&] { corpus = vif::corpus::GenerateCorpus(options); });
+
+			VifCallScanRange_t range{ corpus.target.mapped.data(), corpus.target.mapped.size(), corpus.target.base, { corpus.text }, { corpus.vmp } };
+			std::vector<VifImportCall_t> vecCalls;
+
+			double dScan = vif::bench::BestOf(RUNS, [&] { vecCalls = VifFindImportCalls(range); });
+
+			bool bScanOk = vecCalls.size() == corpus.calls.size();
+
+			for (std::size_t i = 0; bScanOk && i < vecCalls.size(); ++i)
+				bScanOk = vecCalls[i].offset == corpus.calls[i].rva && vecCalls[i].destination == corpus.target.base + corpus.calls[i].stub;
+
+			double dEmulate = 0.0;
+			std::ptrdiff_t nMismatches = -1;
+
+#ifdef VIF_HAVE_MICRO_EMULATOR
+			nMismatches = ResolveStubs(corpus, dEmulate);
+#endif
+
+			std::string sEmulate = nMismatches < 0 ? "-" : std::to_string(dEmulate * 1000.0).substr(0, 8);
+			std::string sStubs = nMismatches < 0 ? "-" : std::to_string(static_cast<std::uint64_t>(nSites / dEmulate));
+
+			std::printf("%-6s %8zu %11.1f %9.2f %13.0f %11s %11s %9.1f\n", bitsize == 64 ? "PE32+" : "PE32", nSites, dGenerate * 1000.0,
+				dScan * 1000.0, nSites / dScan, sEmulate.c_str(), sStubs.c_str(), vif::bench::PeakRssMb());
+
+			if (!bScanOk)
+			{
+				std::printf("  MISMATCH: the scanner found %zu call sites\n", vecCalls.size());
+				bFailed = true;
+			}
+
+			if (nMismatches > 0)
+			{
+				std::printf("  MISMATCH: %td stubs didn't leave for their import\n", nMismatches);
+				bFailed = true;
+			}
+		}
+	}
+
+#ifndef VIF_HAVE_MICRO_EMULATOR
+	std::printf("Built without Zydis, stubs were not emulated.\n");
+#endif
+
+	return bFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+#include "PeCorpus.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//
+// Writes a synthetic target and its dependency to disk. On Windows they can be run through the fixer itself:
+//   VMPImportFixer -snapshot corpus.vifs -image viftarget64.exe -image vifdep64.dll
+//   VMPImportFixer -f corpus.vifs -quiet -metrics metrics.json
+int main(int argc, const char** argv)
+{
+	vif::corpus::CorpusOptions_t options{};
+	const char* szDirectory = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "-bits") == 0 && i + 1 < argc)
+			options.bitsize = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "-sites") == 0 && i + 1 < argc)
+			options.call_sites = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "-exports") == 0 && i + 1 < argc)
+			options.exports = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "-decoys") == 0 && i + 1 < argc)
+			options.decoys_per_site = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+			options.seed = std::strtoull(argv[++i], nullptr, 10);
+		else if (argv[i][0] != '-' && szDirectory == nullptr)
+			szDirectory = argv[i];
+		else
+			szDirectory = nullptr, i = argc;
+	}
+
+	if (szDirectory == nullptr || (options.bitsize != 32 && options.bitsize != 64))
+	{
+		std::printf("Usage: vif_corpus <directory> [-bits 32|64] [-sites n] [-exports n] [-decoys n] [-seed n]\n");
+		return EXIT_FAILURE;
+	}
+
+	vif::corpus::Corpus_t corpus = vif::corpus::GenerateCorpus(options);
+
+	if (!vif::corpus::WriteCorpus(corpus, szDirectory))
+	{
+		std::printf("Could not write to %s\n", szDirectory);
+		return EXIT_FAILURE;
+	}
+
+	std::printf("%s (%zu call sites) and %s written to %s\n", corpus.target.name.c_str(), corpus.calls.size(),
+		corpus.dependency.name.c_str(), szDirectory);
+	return EXIT_SUCCESS;
+}
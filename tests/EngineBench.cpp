@@ -0,0 +1,195 @@
+#include "PeCorpus.hpp"
+#include <cstdlib>
+#include <unicorn/unicorn.h>
+#include "Bench.hpp"
+
+//
+// How Unicorn finds a stub's exit, over the same synthetic stubs: the old per-instruction code hook that looks for the
+// final RET, against letting the RET run and catching the failed fetch outside the image, with a block hook for the
+// budget the way VifEmulator does it. Both have to leave every stub for the import the generator put there.
+namespace
+{
+	constexpr std::size_t SITE_COUNTS[] = { 1000, 10000, 100000 };
+	constexpr std::size_t RUNS = 3;
+	constexpr std::uint64_t STACK_BASE = 0x100000;
+	constexpr std::uint64_t STACK_SIZE = 0x10000;
+	constexpr std::uint64_t BLOCK_BUDGET = 0x10000;
+
+	//! What the code hook called back into once it saw a RET, the fixer's module lookup.
+	struct IExitSink
+	{
+		virtual ~IExitSink() = default;
+		virtual bool IsImport(std::uint64_t address) const = 0;
+	};
+
+	struct DependencySink : IExitSink
+	{
+		std::uint64_t begin = 0;
+		std::uint64_t end = 0;
+
+		bool IsImport(std::uint64_t address) const override
+		{
+			return address >= begin && address < end;
+		}
+	};
+
+	struct Run_t
+	{
+		const IExitSink*	sink = nullptr;
+		uc_mode				mode = UC_MODE_64;
+		std::uint64_t		exit = 0;
+		std::uint64_t		instructions = 0;
+		std::uint64_t		blocks = 0;
+		std::string			name;
+	};
+
+	//
+	// The hook as it was: every instruction is read back and checked for a RET.
+	void CodeHook(uc_engine* uc, uint64_t address, uint32_t size, void* user_data)
+	{
+		Run_t& run = *static_cast<Run_t*>(user_data);
+		std::uint8_t insnbuf[0xf];
+
+		uc_mem_read(uc, address, insnbuf, size);
+		run.name.clear();
+		++run.instructions;
+
+		if (insnbuf[0] == 0xc3 || insnbuf[0] == 0xc2)
+		{
+			std::uint64_t uImport = 0;
+
+			uc_reg_read(uc, run.mode == UC_MODE_64 ? UC_X86_REG_RSP : UC_X86_REG_ESP, &uImport);
+			uc_mem_read(uc, uImport, &uImport, run.mode == UC_MODE_64 ? 8 : 4);
+
+			if (run.sink->IsImport(uImport))
+			{
+				run.exit = uImport;
+				uc_emu_stop(uc);
+			}
+		}
+	}
+
+	bool FetchUnmappedHook(uc_engine* uc, uc_mem_type type, uint64_t address, int size, int64_t value, void* user_data)
+	{
+		static_cast<Run_t*>(user_data)->exit = address;
+		return false;
+	}
+
+	void BlockHook(uc_engine* uc, uint64_t address, uint32_t size, void* user_data)
+	{
+		if (++static_cast<Run_t*>(user_data)->blocks > BLOCK_BUDGET)
+			uc_emu_stop(uc);
+	}
+
+	//! Returns the number of stubs that didn't leave for their import, or -1 if the engine couldn't be set up.
+	std::ptrdiff_t RunStubs(const vif::corpus::Corpus_t& corpus, bool code_hook, double& seconds, std::uint64_t& instructions)
+	{
+		bool b64 = corpus.bitsize == 64;
+		uc_engine* uc = nullptr;
+		uc_hook hook{};
+		uc_hook blockHook{};
+		DependencySink sink;
+		Run_t run;
+
+		sink.begin = corpus.dependency.base;
+		sink.end = corpus.dependency.base + corpus.dependency.mapped.size();
+		run.sink = &sink;
+		run.mode = b64 ? UC_MODE_64 : UC_MODE_32;
+
+		if (uc_open(UC_ARCH_X86, run.mode, &uc) != UC_ERR_OK)
+			return -1;
+
+		//
+		// The dependency is never mapped, so leaving for an import is the only fetch outside the target.
+		bool bReady = uc_mem_map_ptr(uc, corpus.target.base, corpus.target.mapped.size(), UC_PROT_READ | UC_PROT_EXEC,
+				const_cast<std::uint8_t*>(corpus.target.mapped.data())) == UC_ERR_OK &&
+			uc_mem_map(uc, STACK_BASE, STACK_SIZE, UC_PROT_READ | UC_PROT_WRITE) == UC_ERR_OK;
+
+		if (bReady && code_hook)
+			bReady = uc_hook_add(uc, &hook, UC_HOOK_CODE, reinterpret_cast<void*>(CodeHook), &run, 1, 0) == UC_ERR_OK;
+		else if (bReady)
+			bReady = uc_hook_add(uc, &hook, UC_HOOK_MEM_FETCH_UNMAPPED, reinterpret_cast<void*>(FetchUnmappedHook), &run, 1, 0) == UC_ERR_OK &&
+				uc_hook_add(uc, &blockHook, UC_HOOK_BLOCK, reinterpret_cast<void*>(BlockHook), &run, 1, 0) == UC_ERR_OK;
+
+		if (!bReady)
+		{
+			uc_close(uc);
+			return -1;
+		}
+
+		std::ptrdiff_t nMismatches = 0;
+
+		seconds = vif::bench::BestOf(RUNS, [&]
+			{
+				nMismatches = 0;
+				run.instructions = 0;
+
+				for (auto& call : corpus.calls)
+				{
+					std::uint64_t uStack = (STACK_BASE + STACK_SIZE - 0x1000) & ~0xfull;
+					std::uint64_t uReturn = corpus.target.base + call.rva + 5;
+
+					run.exit = 0;
+					run.blocks = 0;
+
+					uc_mem_write(uc, uStack, &uReturn, b64 ? 8 : 4);
+					uc_reg_write(uc, b64 ? UC_X86_REG_RSP : UC_X86_REG_ESP, &uStack);
+					uc_emu_start(uc, corpus.target.base + call.stub, 0, 0, 0);
+
+					if (run.exit != call.import)
+						++nMismatches;
+				}
+			});
+
+		instructions = run.instructions;
+		uc_close(uc);
+		return nMismatches;
+	}
+}
+
+int main()
+{
+	bool bFailed = false;
+
+	std::printf("%-6s %8s %12s %14s %14s %14s %14s %8s\n", "format", "sites", "instructions", "code hook ms", "code insn/s",
+		"exit hook ms", "exit insn/s", "speedup");
+
+	for (std::size_t bitsize : { 32, 64 })
+	{
+		for (std::size_t nSites : SITE_COUNTS)
+		{
+			vif::corpus::CorpusOptions_t options{};
+
+			options.bitsize = bitsize;
+			options.call_sites = nSites;
+
+			vif::corpus::Corpus_t corpus = vif::corpus::GenerateCorpus(options);
+
+			//
+			// Only the code hook counts instructions, both engines run the very same ones.
+			double dCode = 0.0, dExit = 0.0;
+			std::uint64_t nInstructions = 0, nUnused = 0;
+			std::ptrdiff_t nCodeMismatches = RunStubs(corpus, true, dCode, nInstructions);
+			std::ptrdiff_t nExitMismatches = RunStubs(corpus, false, dExit, nUnused);
+
+			if (nCodeMismatches < 0 || nExitMismatches < 0)
+			{
+				std::printf("Could not set up Unicorn\n");
+				return EXIT_FAILURE;
+			}
+
+			std::printf("%-6s %8zu %12llu %14.1f %14.0f %14.1f %14.0f %7.2fx\n", bitsize == 64 ? "PE32+" : "PE32", nSites,
+				static_cast<unsigned long long>(nInstructions), dCode * 1000.0, nInstructions / dCode, dExit * 1000.0,
+				nInstructions / dExit, dCode / dExit);
+
+			if (nCodeMismatches > 0 || nExitMismatches > 0)
+			{
+				std::printf("  MISMATCH: %td stubs with the code hook and %td with the exit hook didn't leave for their import\n",
+					nCodeMismatches, nExitMismatches);
+				bFailed = true;
+			}
+		}
+	}
+
+	return bFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+#include <msc/MemorySource.hpp>
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+
+using namespace vif;
+
+namespace
+{
+	std::vector<std::uint8_t> MakeBuffer(std::size_t size, std::uint8_t first)
+	{
+		std::vector<std::uint8_t> vecBuffer(size);
+
+		std::iota(vecBuffer.begin(), vecBuffer.end(), first);
+		return vecBuffer;
+	}
+
+	//! A dump file in the temp directory, removed again at the end of the test.
+	class TempDump
+	{
+	public:
+		TempDump(std::string_view name, const std::vector<std::uint8_t>& data)
+			: m_path(std::filesystem::temp_directory_path() / name)
+		{
+			std::ofstream stream(m_path, std::ios::binary);
+			stream.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		}
+
+		~TempDump()
+		{
+			std::error_code ec;
+			std::filesystem::remove(m_path, ec);
+		}
+
+		std::string path() const {
+			return m_path.string();
+		}
+
+	private:
+		std::filesystem::path	m_path;
+	};
+}
+
+TEST(BufferMemorySource, RejectsOverlappingRanges)
+{
+	auto vecData = MakeBuffer(0x100, 0);
+	BufferMemorySource source;
+
+	EXPECT_TRUE(source.AddRange(0x1000, vecData.data(), 0x100));
+	EXPECT_FALSE(source.AddRange(0x10FF, vecData.data(), 0x10));
+	EXPECT_FALSE(source.AddRange(0xF80, vecData.data(), 0x81));
+	EXPECT_FALSE(source.AddRange(0x1000, vecData.data(), 0x100));
+	EXPECT_FALSE(source.AddRange(0x2000, nullptr, 0x10));
+	EXPECT_FALSE(source.AddRange(0x2000, vecData.data(), 0));
+
+	//
+	// Touching isn't overlapping.
+	EXPECT_TRUE(source.AddRange(0x1100, vecData.data(), 0x10));
+	EXPECT_TRUE(source.AddRange(0xF00, vecData.data(), 0x100));
+}
+
+TEST(BufferMemorySource, QueryRangesClipsAndMerges)
+{
+	auto vecData = MakeBuffer(0x300, 0);
+	BufferMemorySource source;
+
+	//
+	// Added out of order, two of them adjacent.
+	ASSERT_TRUE(source.AddRange(0x3000, vecData.data(), 0x100));
+	ASSERT_TRUE(source.AddRange(0x1000, vecData.data(), 0x100));
+	ASSERT_TRUE(source.AddRange(0x1100, vecData.data() + 0x100, 0x100));
+
+	auto vecRanges = source.QueryRanges(0x1080, 0x2000);
+
+	ASSERT_EQ(vecRanges.size(), 2u);
+	EXPECT_EQ(vecRanges[0].begin, 0x1080u);
+	EXPECT_EQ(vecRanges[0].end, 0x1200u);
+	EXPECT_EQ(vecRanges[1].begin, 0x3000u);
+	EXPECT_EQ(vecRanges[1].end, 0x3080u);
+
+	EXPECT_TRUE(source.QueryRanges(0x2000, 0x1000).empty());
+}
+
+TEST(BufferMemorySource, ReadRangeSpansBuffers)
+{
+	auto vecFirst = MakeBuffer(0x100, 0);
+	auto vecSecond = MakeBuffer(0x100, 0x80);
+	BufferMemorySource source;
+	std::vector<std::uint8_t> vecOut(0x100, 0xCC);
+
+	ASSERT_TRUE(source.AddRange(0x1000, vecFirst.data(), 0x100));
+	ASSERT_TRUE(source.AddRange(0x1100, vecSecond.data(), 0x100));
+
+	EXPECT_EQ(source.ReadRange(0x1080, vecOut.data(), vecOut.size()), 0x100u);
+	EXPECT_TRUE(std::equal(vecOut.begin(), vecOut.begin() + 0x80, vecFirst.begin() + 0x80));
+	EXPECT_TRUE(std::equal(vecOut.begin() + 0x80, vecOut.end(), vecSecond.begin()));
+}
+
+TEST(BufferMemorySource, ReadZeroFillsGaps)
+{
+	auto vecData = MakeBuffer(0x100, 1);
+	BufferMemorySource source;
+	std::vector<std::uint8_t> vecOut(0x300, 0xCC);
+
+	ASSERT_TRUE(source.AddRange(0x1100, vecData.data(), 0x100));
+
+	EXPECT_EQ(source.Read(0x1000, vecOut.data(), vecOut.size()), 0x100u);
+	EXPECT_TRUE(std::all_of(vecOut.begin(), vecOut.begin() + 0x100, [](std::uint8_t b) { return b == 0; }));
+	EXPECT_TRUE(std::equal(vecOut.begin() + 0x100, vecOut.begin() + 0x200, vecData.begin()));
+	EXPECT_TRUE(std::all_of(vecOut.begin() + 0x200, vecOut.end(), [](std::uint8_t b) { return b == 0; }));
+}
+
+TEST(BufferMemorySource, ParallelReadMatchesSerialRead)
+{
+	std::vector<std::vector<std::uint8_t>> vecBuffers;
+	BufferMemorySource source;
+
+	//
+	// Many ranges with holes in between, so the workers have something to split.
+	for (std::size_t i = 0; i < 64; ++i)
+	{
+		vecBuffers.push_back(MakeBuffer(0x800, static_cast<std::uint8_t>(i)));
+		ASSERT_TRUE(source.AddRange(0x10000 + i * 0x1000, vecBuffers.back().data(), 0x800));
+	}
+
+	std::vector<std::uint8_t> vecSerial(0x50000, 0xCC);
+	std::vector<std::uint8_t> vecParallel(0x50000, 0xCC);
+
+	EXPECT_EQ(source.Read(0x8000, vecSerial.data(), vecSerial.size(), 1), 64u * 0x800);
+	EXPECT_EQ(source.Read(0x8000, vecParallel.data(), vecParallel.size(), 0), 64u * 0x800);
+	EXPECT_EQ(vecSerial, vecParallel);
+}
+
+TEST(FileMemorySource, RejectsMissingEmptyAndOverlappingFiles)
+{
+	TempDump first("vif_dump_first.bin", MakeBuffer(0x100, 0));
+	TempDump empty("vif_dump_empty.bin", {});
+	FileMemorySource source;
+
+	EXPECT_TRUE(source.AddFile(first.path(), 0x1000));
+	EXPECT_FALSE(source.AddFile(first.path(), 0x10FF));
+	EXPECT_FALSE(source.AddFile(empty.path(), 0x4000));
+	EXPECT_FALSE(source.AddFile((std::filesystem::temp_directory_path() / "vif_dump_missing.bin").string(), 0x4000));
+
+	//
+	// Touching isn't overlapping.
+	EXPECT_TRUE(source.AddFile(first.path(), 0x1100));
+}
+
+TEST(FileMemorySource, ReadsDumpsAtTheirAddresses)
+{
+	auto vecFirst = MakeBuffer(0x1800, 0);
+	auto vecSecond = MakeBuffer(0x800, 0x40);
+	TempDump first("vif_dump_a.bin", vecFirst);
+	TempDump second("vif_dump_b.bin", vecSecond);
+	FileMemorySource source;
+	std::vector<std::uint8_t> vecOut(0x3000, 0xCC);
+
+	ASSERT_TRUE(source.AddFile(second.path(), 0x3000));
+	ASSERT_TRUE(source.AddFile(first.path(), 0x1800));
+
+	auto vecRanges = source.QueryRanges(0x1000, 0x3000);
+
+	ASSERT_EQ(vecRanges.size(), 1u);
+	EXPECT_EQ(vecRanges[0].begin, 0x1800u);
+	EXPECT_EQ(vecRanges[0].end, 0x3800u);
+
+	//
+	// One coalesced range over both files, zeroes on either side of it.
+	EXPECT_EQ(source.Read(0x1000, vecOut.data(), vecOut.size()), 0x2000u);
+	EXPECT_TRUE(std::all_of(vecOut.begin(), vecOut.begin() + 0x800, [](std::uint8_t b) { return b == 0; }));
+	EXPECT_TRUE(std::equal(vecOut.begin() + 0x800, vecOut.begin() + 0x2000, vecFirst.begin()));
+	EXPECT_TRUE(std::equal(vecOut.begin() + 0x2000, vecOut.begin() + 0x2800, vecSecond.begin()));
+	EXPECT_TRUE(std::all_of(vecOut.begin() + 0x2800, vecOut.end(), [](std::uint8_t b) { return b == 0; }));
+}
+
+TEST(FileMemorySource, ParallelReadMatchesBuffer)
+{
+	std::vector<std::vector<std::uint8_t>> vecBuffers;
+	std::vector<std::unique_ptr<TempDump>> vecDumps;
+	FileMemorySource fileSource;
+	BufferMemorySource bufferSource;
+
+	for (std::size_t i = 0; i < 16; ++i)
+	{
+		vecBuffers.push_back(MakeBuffer(0x800, static_cast<std::uint8_t>(i)));
+		vecDumps.push_back(std::make_unique<TempDump>("vif_dump_" + std::to_string(i) + ".bin", vecBuffers.back()));
+
+		ASSERT_TRUE(fileSource.AddFile(vecDumps.back()->path(), 0x10000 + i * 0x1000));
+		ASSERT_TRUE(bufferSource.AddRange(0x10000 + i * 0x1000, vecBuffers.back().data(), 0x800));
+	}
+
+	std::vector<std::uint8_t> vecFile(0x18000, 0xCC);
+	std::vector<std::uint8_t> vecBuffer(0x18000, 0xCC);
+
+	EXPECT_EQ(fileSource.Read(0x8000, vecFile.data(), vecFile.size(), 0), 16u * 0x800);
+	EXPECT_EQ(bufferSource.Read(0x8000, vecBuffer.data(), vecBuffer.size(), 1), 16u * 0x800);
+	EXPECT_EQ(vecFile, vecBuffer);
+}
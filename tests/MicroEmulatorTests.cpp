@@ -0,0 +1,238 @@
+#include <VIFMicroEmulator.hpp>
+#include <gtest/gtest.h>
+#include <bit>
+#include <cstring>
+
+//
+// Fixed stub bytes run through the micro emulator and, when it is available, through a bare Unicorn engine
+// set up the way VifEmulator sets it up. Both have to leave the stub for the same address.
+namespace
+{
+	constexpr std::uint64_t IMAGE_SIZE = 0x3000;
+	constexpr std::uint64_t STUB_RVA = 0x100;
+	constexpr std::uint64_t DATA_RVA = 0x2000;
+	//! Where the call that led into the stub would return to, inside of the image.
+	constexpr std::uint64_t RETURN_RVA = 0x50;
+	constexpr std::uint64_t STACK_BASE = 0x100000;
+	constexpr std::uint64_t STACK_SIZE = 0x10000;
+	constexpr std::uint64_t STACK_POINTER = (STACK_BASE + STACK_SIZE - 0x1000) & ~0xfull;
+
+	template<size_t BitSize>
+	constexpr std::uint64_t IMAGE_BASE = BitSize == 64 ? 0x140000000ull : 0x400000ull;
+
+	//! What the stubs compute, never mapped by either engine.
+	template<size_t BitSize>
+	constexpr std::uint64_t IMPORT = BitSize == 64 ? 0x7ff800001000ull : 0x77001000ull;
+
+	//! A stub at STUB_RVA with the pointer it decodes at DATA_RVA.
+	struct Stub_t
+	{
+		std::vector<std::uint8_t>	code;
+		std::uint64_t				data;
+	};
+
+	//! Image bytes the way both engines see them, int3 everywhere but the stub and its data.
+	template<size_t BitSize>
+	std::vector<std::uint8_t> MakeImage(const Stub_t& stub)
+	{
+		std::vector<std::uint8_t> vecImage(IMAGE_SIZE, 0xcc);
+
+		std::memcpy(vecImage.data() + STUB_RVA, stub.code.data(), stub.code.size());
+		std::memcpy(vecImage.data() + DATA_RVA, &stub.data, BitSize / 8);
+		return vecImage;
+	}
+
+	//! rel32 of a RIP relative operand reaching DATA_RVA, the instruction ends at `next` (relative to the stub).
+	void PatchRipToData(Stub_t& stub, std::size_t at, std::size_t next)
+	{
+		std::int32_t disp = static_cast<std::int32_t>(DATA_RVA - (STUB_RVA + next));
+		std::memcpy(stub.code.data() + at, &disp, sizeof(disp));
+	}
+
+	//! Absolute address of DATA_RVA, for 32 bit stubs.
+	void PatchAbsToData(Stub_t& stub, std::size_t at)
+	{
+		std::uint32_t address = static_cast<std::uint32_t>(IMAGE_BASE<32> + DATA_RVA);
+		std::memcpy(stub.code.data() + at, &address, sizeof(address));
+	}
+
+	std::uint64_t ByteSwap64(std::uint64_t x)
+	{
+		std::uint64_t y = 0;
+
+		for (int i = 0; i < 8; ++i, x >>= 8)
+			y = (y << 8) | (x & 0xff);
+
+		return y;
+	}
+
+	template<size_t BitSize>
+	bool RunMicro(const Stub_t& stub, std::uint64_t& exit_address)
+	{
+		ZydisDecoder decoder;
+
+		if (!ZYAN_SUCCESS(ZydisDecoderInit(&decoder,
+			BitSize == 64 ? ZYDIS_MACHINE_MODE_LONG_64 : ZYDIS_MACHINE_MODE_LONG_COMPAT_32,
+			BitSize == 64 ? ZYDIS_ADDRESS_WIDTH_64 : ZYDIS_ADDRESS_WIDTH_32)))
+			return false;
+
+		std::vector<std::uint8_t> vecImage = MakeImage<BitSize>(stub);
+		std::vector<VifMemoryRegion_t> vecRegions{ { IMAGE_BASE<BitSize>, IMAGE_SIZE, vecImage.data(), UC_PROT_READ | UC_PROT_EXEC } };
+		VifMicroEmulator<BitSize> micro(&decoder);
+
+		micro.Initialize(&vecRegions, nullptr, STACK_BASE, STACK_SIZE, STACK_POINTER);
+
+		return micro.Run({ IMAGE_BASE<BitSize> + STUB_RVA, IMAGE_BASE<BitSize> + RETURN_RVA, IMAGE_BASE<BitSize>, IMAGE_BASE<BitSize> + IMAGE_SIZE },
+			VifMicroEmulator<BitSize>::MAX_INSTRUCTIONS, exit_address);
+	}
+
+#ifdef VIF_HAVE_UNICORN
+	//! Same as VifEmulator: the import is never mapped, so the stub leaving for it is an unmapped fetch.
+	bool FetchUnmappedHook(uc_engine*, uc_mem_type, uint64_t address, int, int64_t, void* user_data)
+	{
+		*static_cast<std::uint64_t*>(user_data) = address;
+		return false;
+	}
+
+	template<size_t BitSize>
+	bool RunUnicorn(const Stub_t& stub, std::uint64_t& exit_address)
+	{
+		using AddressType = typename VifMicroEmulator<BitSize>::AddressType;
+
+		std::vector<std::uint8_t> vecImage = MakeImage<BitSize>(stub);
+		uc_engine* uc = nullptr;
+		uc_hook hook{};
+		std::uint64_t uExit = 0;
+		std::uint64_t uStack = STACK_POINTER;
+		AddressType rtnaddress = static_cast<AddressType>(IMAGE_BASE<BitSize> + RETURN_RVA);
+
+		if (uc_open(UC_ARCH_X86, BitSize == 64 ? UC_MODE_64 : UC_MODE_32, &uc) != UC_ERR_OK)
+			return false;
+
+		bool bExited = uc_mem_map_ptr(uc, IMAGE_BASE<BitSize>, IMAGE_SIZE, UC_PROT_READ | UC_PROT_EXEC, vecImage.data()) == UC_ERR_OK &&
+			uc_mem_map(uc, STACK_BASE, STACK_SIZE, UC_PROT_READ | UC_PROT_WRITE) == UC_ERR_OK &&
+			uc_mem_write(uc, STACK_POINTER, &rtnaddress, sizeof(rtnaddress)) == UC_ERR_OK &&
+			uc_reg_write(uc, BitSize == 64 ? UC_X86_REG_RSP : UC_X86_REG_ESP, &uStack) == UC_ERR_OK &&
+			uc_hook_add(uc, &hook, UC_HOOK_MEM_FETCH_UNMAPPED, reinterpret_cast<void*>(FetchUnmappedHook), &uExit, 1, 0) == UC_ERR_OK &&
+			uc_emu_start(uc, IMAGE_BASE<BitSize> + STUB_RVA, 0, 0, VifMicroEmulator<BitSize>::MAX_INSTRUCTIONS) == UC_ERR_FETCH_UNMAPPED;
+
+		uc_close(uc);
+		exit_address = uExit;
+		return bExited;
+	}
+#endif
+
+	template<size_t BitSize>
+	void ExpectExit(const Stub_t& stub, std::uint64_t expected)
+	{
+		std::uint64_t uMicro = 0;
+
+		ASSERT_TRUE(RunMicro<BitSize>(stub, uMicro));
+		EXPECT_EQ(uMicro, expected);
+
+#ifdef VIF_HAVE_UNICORN
+		std::uint64_t uUnicorn = 0;
+
+		ASSERT_TRUE(RunUnicorn<BitSize>(stub, uUnicorn));
+		EXPECT_EQ(uMicro, uUnicorn);
+#endif
+	}
+}
+
+TEST(MicroEmulator, PushMovLeaXchgRet64)
+{
+	//
+	// push rbx; mov rbx, [rip+data]; lea rbx, [rbx+0x1234]; xchg [rsp], rbx; ret
+	Stub_t stub{ { 0x53, 0x48, 0x8b, 0x1d, 0, 0, 0, 0, 0x48, 0x8d, 0x9b, 0x34, 0x12, 0x00, 0x00, 0x48, 0x87, 0x1c, 0x24, 0xc3 },
+		IMPORT<64> - 0x1234 };
+
+	PatchRipToData(stub, 4, 8);
+	ExpectExit<64>(stub, IMPORT<64>);
+}
+
+TEST(MicroEmulator, RotatesAndBitOps64)
+{
+	//
+	// push rax; mov rax, [rip+data]; rol rax, 0x11; bswap rax; not rax; neg rax; xor rax, 0x55aa; sub rax, 0x10;
+	// xchg [rsp], rax; ret
+	Stub_t stub{ { 0x50, 0x48, 0x8b, 0x05, 0, 0, 0, 0, 0x48, 0xc1, 0xc0, 0x11, 0x48, 0x0f, 0xc8, 0x48, 0xf7, 0xd0,
+		0x48, 0xf7, 0xd8, 0x48, 0x35, 0xaa, 0x55, 0x00, 0x00, 0x48, 0x83, 0xe8, 0x10, 0x48, 0x87, 0x04, 0x24, 0xc3 }, 0 };
+
+	stub.data = std::rotr(ByteSwap64(~(0 - ((IMPORT<64> + 0x10) ^ 0x55aa))), 0x11);
+
+	PatchRipToData(stub, 4, 8);
+	ExpectExit<64>(stub, IMPORT<64>);
+}
+
+TEST(MicroEmulator, RegisterWrites32ZeroExtend64)
+{
+	//
+	// push rax; mov rax, -1; mov eax, 0x1000; mov rcx, [rip+data]; add rax, rcx; xchg [rsp], rax; ret
+	Stub_t stub{ { 0x50, 0x48, 0xc7, 0xc0, 0xff, 0xff, 0xff, 0xff, 0xb8, 0x00, 0x10, 0x00, 0x00, 0x48, 0x8b, 0x0d, 0, 0, 0, 0,
+		0x48, 0x01, 0xc8, 0x48, 0x87, 0x04, 0x24, 0xc3 }, IMPORT<64> - 0x1000 };
+
+	PatchRipToData(stub, 16, 20);
+	ExpectExit<64>(stub, IMPORT<64>);
+}
+
+TEST(MicroEmulator, RetImm64)
+{
+	//
+	// jmp +1; int3; push rcx; mov rcx, [rip+data]; xchg [rsp], rcx; ret 8
+	Stub_t stub{ { 0xeb, 0x01, 0xcc, 0x51, 0x48, 0x8b, 0x0d, 0, 0, 0, 0, 0x48, 0x87, 0x0c, 0x24, 0xc2, 0x08, 0x00 }, IMPORT<64> };
+
+	PatchRipToData(stub, 7, 11);
+	ExpectExit<64>(stub, IMPORT<64>);
+}
+
+TEST(MicroEmulator, PushPop64)
+{
+	//
+	// push rax; push rbx; mov rbx, [rip+data]; lea rbx, [rbx+0x10]; mov rax, rbx; pop rbx; xchg [rsp], rax; ret
+	Stub_t stub{ { 0x50, 0x53, 0x48, 0x8b, 0x1d, 0, 0, 0, 0, 0x48, 0x8d, 0x5b, 0x10, 0x48, 0x89, 0xd8, 0x5b, 0x48, 0x87, 0x04, 0x24, 0xc3 },
+		IMPORT<64> - 0x10 };
+
+	PatchRipToData(stub, 5, 9);
+	ExpectExit<64>(stub, IMPORT<64>);
+}
+
+TEST(MicroEmulator, RotatesAndRetImm32)
+{
+	//
+	// push eax; mov eax, [data]; add eax, 0x10; rol eax, 8; ror eax, 8; bswap eax; bswap eax; xchg [esp], eax; ret 4
+	Stub_t stub{ { 0x50, 0xa1, 0, 0, 0, 0, 0x83, 0xc0, 0x10, 0xc1, 0xc0, 0x08, 0xc1, 0xc8, 0x08, 0x0f, 0xc8, 0x0f, 0xc8,
+		0x87, 0x04, 0x24, 0xc2, 0x04, 0x00 }, IMPORT<32> - 0x10 };
+
+	PatchAbsToData(stub, 2);
+	ExpectExit<32>(stub, IMPORT<32>);
+}
+
+TEST(MicroEmulator, Wraparound32)
+{
+	//
+	// push eax; mov eax, [data]; sub eax, 0xfffffff0; xchg [esp], eax; ret
+	Stub_t stub{ { 0x50, 0xa1, 0, 0, 0, 0, 0x2d, 0xf0, 0xff, 0xff, 0xff, 0x87, 0x04, 0x24, 0xc3 }, IMPORT<32> - 0x10 };
+
+	PatchAbsToData(stub, 2);
+	ExpectExit<32>(stub, IMPORT<32>);
+}
+
+TEST(MicroEmulator, ScaledLea32)
+{
+	//
+	// push ecx; mov ecx, [data]; lea ecx, [ecx+ecx*1+0x10]; xchg [esp], ecx; ret
+	Stub_t stub{ { 0x51, 0x8b, 0x0d, 0, 0, 0, 0, 0x8d, 0x4c, 0x09, 0x10, 0x87, 0x0c, 0x24, 0xc3 }, (IMPORT<32> - 0x10) / 2 };
+
+	PatchAbsToData(stub, 3);
+	ExpectExit<32>(stub, IMPORT<32>);
+}
+
+TEST(MicroEmulator, GivesUpOnFlags)
+{
+	//
+	// jz +0; ret. Flags aren't tracked, the stub has to go to Unicorn.
+	Stub_t stub{ { 0x74, 0x00, 0xc3 }, 0 };
+	std::uint64_t uExit = 0;
+
+	EXPECT_FALSE(RunMicro<64>(stub, uExit));
+}
@@ -0,0 +1,108 @@
+#include <pepp/misc/BytePattern.hpp>
+#include <cstdlib>
+#include <string_view>
+#include "Bench.hpp"
+
+//
+// Scans a 64MB section for the call pattern every run starts with, once with the string matcher
+// pepp::Image::FindBinarySequence used before patterns were compiled, and once with ScanPattern.
+namespace
+{
+	constexpr std::size_t SECTION_SIZE = 64ull << 20;
+	constexpr std::size_t RUNS = 5;
+
+	//! FindBinarySequence as it was: the pattern string is parsed again at every offset.
+	//! `data` needs a pattern's worth of bytes past `size`, it reads over the end of the section.
+	std::vector<std::uint32_t> FindBinarySequenceOld(const std::vector<std::uint8_t>& data, std::size_t size, std::string_view binary_seq)
+	{
+		constexpr auto ascii_to_byte = [](const char ch) {
+			if (ch >= '0' && ch <= '9')
+				return std::uint8_t(ch - '0');
+			if (ch >= 'A' && ch <= 'F')
+				return std::uint8_t(ch - 'A' + '\n');
+			return std::uint8_t(ch - 'a' + '\n');
+		};
+
+		std::vector<std::uint32_t> offsets{};
+		std::uint32_t result = 0;
+		std::uint32_t match_count = 0;
+
+		for (std::uint32_t i = 0; i <= size; ++i)
+		{
+			for (std::size_t c = 0; c < binary_seq.size();)
+			{
+				if (binary_seq[c] == ' ')
+				{
+					++c;
+					continue;
+				}
+
+				if (binary_seq[c] == '?')
+				{
+					++c;
+					++match_count;
+					continue;
+				}
+
+				if (data[i + match_count++] != ((ascii_to_byte(binary_seq[c]) << 4) | ascii_to_byte(binary_seq[c + 1])))
+				{
+					result = 0;
+					break;
+				}
+
+				result = i;
+				c += 2;
+			}
+
+			if (result)
+			{
+				offsets.emplace_back(i);
+				i += match_count - 1;
+			}
+
+			match_count = 0;
+			result = 0;
+		}
+
+		return offsets;
+	}
+}
+
+int main()
+{
+	vif::bench::XorShift rng(0x5EED);
+	std::vector<std::uint8_t> vecSection(SECTION_SIZE + pepp::BytePattern::MAX_LENGTH, 0);
+
+	//
+	// Random bytes with an E8 about every 100 bytes, roughly what .text looks like to the scanner.
+	for (std::size_t i = 0; i < SECTION_SIZE; ++i)
+		vecSection[i] = static_cast<std::uint8_t>(rng.Below(100) == 0 ? 0xe8 : rng.Next());
+
+	vecSection[0] = 0x90;
+
+	constexpr std::string_view PATTERN = "E8 ? ? ? ?";
+	constexpr pepp::BytePattern pattern(PATTERN);
+	std::vector<std::uint32_t> vecOld, vecNew;
+
+	double dOld = vif::bench::BestOf(RUNS, [&] { vecOld = FindBinarySequenceOld(vecSection, SECTION_SIZE - pattern.size(), PATTERN); });
+	double dNew = vif::bench::BestOf(RUNS, [&] { vecNew = pepp::ScanPattern(vecSection.data(), SECTION_SIZE, pattern); });
+
+	//
+	// The old matcher stops one pattern short of the end, so it is only compared up to there.
+	while (!vecNew.empty() && vecNew.back() > SECTION_SIZE - pattern.size())
+		vecNew.pop_back();
+
+	double dMegabytes = static_cast<double>(SECTION_SIZE) / (1024.0 * 1024.0);
+
+	std::printf("pattern \"%.*s\" over %.0f MB, %zu matches\n", static_cast<int>(PATTERN.size()), PATTERN.data(), dMegabytes, vecNew.size());
+	std::printf("  string matcher  %8.1f ms  %8.1f MB/s\n", dOld * 1000.0, dMegabytes / dOld);
+	std::printf("  ScanPattern     %8.1f ms  %8.1f MB/s  (%.1fx)\n", dNew * 1000.0, dMegabytes / dNew, dOld / dNew);
+
+	if (vecOld != vecNew)
+	{
+		std::printf("  MISMATCH: %zu matches with the string matcher\n", vecOld.size());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
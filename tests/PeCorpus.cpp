@@ -0,0 +1,581 @@
+#include "PeCorpus.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <filesystem>
+#include <fstream>
+#include "Bench.hpp"
+
+using namespace vif::corpus;
+
+namespace
+{
+	constexpr std::uint32_t SECTION_ALIGNMENT = 0x1000;
+	constexpr std::uint32_t FILE_ALIGNMENT = 0x200;
+	constexpr std::uint32_t SIZE_OF_HEADERS = 0x400;
+	constexpr std::uint32_t PE_OFFSET = 0x40;
+
+	constexpr std::uint32_t SCN_CODE = 0x60000020;
+	constexpr std::uint32_t SCN_RDATA = 0x40000040;
+
+	//! Call sites and decoys are fixed size, so .text can be laid out before any stub is written.
+	constexpr std::uint32_t FILLER_SIZE = 16;
+	constexpr std::uint32_t DECOY_SIZE = 8;
+	constexpr std::uint32_t SITE_SIZE = 8;
+	constexpr std::uint32_t EXPORT_SIZE = 16;
+
+	constexpr std::uint32_t Align(std::uint32_t value, std::uint32_t alignment) noexcept
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	//! Little endian appender
+	class ByteWriter
+	{
+	public:
+		explicit ByteWriter(std::vector<std::uint8_t>& out) noexcept
+			: m_out(out)
+		{
+		}
+
+		void Put(std::uint64_t value, std::size_t size)
+		{
+			for (std::size_t i = 0; i < size; ++i)
+				m_out.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+		}
+
+		void Put8(std::uint8_t value) { Put(value, 1); }
+		void Put16(std::uint16_t value) { Put(value, 2); }
+		void Put32(std::uint32_t value) { Put(value, 4); }
+		void Put64(std::uint64_t value) { Put(value, 8); }
+
+		void PutBytes(std::initializer_list<std::uint8_t> bytes) {
+			m_out.insert(m_out.end(), bytes);
+		}
+
+		void PadTo(std::size_t size, std::uint8_t fill = 0)
+		{
+			if (m_out.size() < size)
+				m_out.resize(size, fill);
+		}
+
+		std::size_t size() const noexcept {
+			return m_out.size();
+		}
+
+	private:
+		std::vector<std::uint8_t>& m_out;
+	};
+
+	void PutAt(std::vector<std::uint8_t>& out, std::size_t offset, std::uint64_t value, std::size_t size)
+	{
+		for (std::size_t i = 0; i < size; ++i)
+			out[offset + i] = static_cast<std::uint8_t>(value >> (i * 8));
+	}
+
+	struct Section_t
+	{
+		char						name[8];
+		std::uint32_t				characteristics;
+		std::uint32_t				rva;
+		std::vector<std::uint8_t>	data;
+	};
+
+	//! Write the headers and lay the sections out, both on disk and in memory.
+	void BuildImage(CorpusImage_t& image, std::size_t bitsize, bool dll, std::uint32_t entry, const std::vector<Section_t>& sections,
+		std::uint32_t export_rva, std::uint32_t export_size)
+	{
+		bool b64 = bitsize == 64;
+		std::vector<std::uint8_t> vecHeaders;
+		ByteWriter w(vecHeaders);
+
+		std::uint32_t uSizeOfImage = Align(sections.back().rva + static_cast<std::uint32_t>(sections.back().data.size()), SECTION_ALIGNMENT);
+		std::uint32_t uSizeOfCode = 0;
+		std::uint32_t uSizeOfData = 0;
+
+		for (auto& section : sections)
+			((section.characteristics & 0x20) ? uSizeOfCode : uSizeOfData) += Align(static_cast<std::uint32_t>(section.data.size()), FILE_ALIGNMENT);
+
+		//
+		// IMAGE_DOS_HEADER, only e_magic and e_lfanew matter.
+		w.PutBytes({ 'M', 'Z' });
+		w.PadTo(0x3c);
+		w.Put32(PE_OFFSET);
+		w.PadTo(PE_OFFSET);
+
+		//
+		// IMAGE_FILE_HEADER. No relocations, the images only ever load at their preferred base.
+		std::uint16_t uCharacteristics = 0x0001 | 0x0002 | (b64 ? 0x0020 : 0x0100) | (dll ? 0x2000 : 0);
+
+		w.PutBytes({ 'P', 'E', 0, 0 });
+		w.Put16(b64 ? 0x8664 : 0x014c);
+		w.Put16(static_cast<std::uint16_t>(sections.size()));
+		w.Put32(0);
+		w.Put32(0);
+		w.Put32(0);
+		w.Put16(b64 ? 240 : 224);
+		w.Put16(uCharacteristics);
+
+		//
+		// IMAGE_OPTIONAL_HEADER32/64
+		std::size_t nPtr = b64 ? 8 : 4;
+
+		w.Put16(b64 ? 0x20b : 0x10b);
+		w.Put8(14);
+		w.Put8(0);
+		w.Put32(uSizeOfCode);
+		w.Put32(uSizeOfData);
+		w.Put32(0);
+		w.Put32(entry);
+		w.Put32(sections.front().rva);
+		if (!b64)
+			w.Put32(sections.size() > 1 ? sections[1].rva : 0);
+		w.Put(image.base, nPtr);
+		w.Put32(SECTION_ALIGNMENT);
+		w.Put32(FILE_ALIGNMENT);
+		w.Put16(6);
+		w.Put16(0);
+		w.Put16(0);
+		w.Put16(0);
+		w.Put16(6);
+		w.Put16(0);
+		w.Put32(0);
+		w.Put32(uSizeOfImage);
+		w.Put32(SIZE_OF_HEADERS);
+		w.Put32(0);
+		w.Put16(3);
+		w.Put16(0x0100);
+		w.Put(0x100000, nPtr);
+		w.Put(0x1000, nPtr);
+		w.Put(0x100000, nPtr);
+		w.Put(0x1000, nPtr);
+		w.Put32(0);
+		w.Put32(16);
+
+		for (std::size_t i = 0; i < 16; ++i)
+		{
+			w.Put32(i == 0 ? export_rva : 0);
+			w.Put32(i == 0 ? export_size : 0);
+		}
+
+		//
+		// IMAGE_SECTION_HEADERs, raw data follows the headers in section order.
+		std::uint32_t uRawOffset = SIZE_OF_HEADERS;
+
+		for (auto& section : sections)
+		{
+			std::uint32_t uRawSize = Align(static_cast<std::uint32_t>(section.data.size()), FILE_ALIGNMENT);
+
+			for (char ch : section.name)
+				w.Put8(static_cast<std::uint8_t>(ch));
+
+			w.Put32(static_cast<std::uint32_t>(section.data.size()));
+			w.Put32(section.rva);
+			w.Put32(uRawSize);
+			w.Put32(uRawOffset);
+			w.Put32(0);
+			w.Put32(0);
+			w.Put16(0);
+			w.Put16(0);
+			w.Put32(section.characteristics);
+
+			uRawOffset += uRawSize;
+		}
+
+		w.PadTo(SIZE_OF_HEADERS);
+
+		image.file = vecHeaders;
+		image.mapped.assign(uSizeOfImage, 0);
+		std::copy(vecHeaders.begin(), vecHeaders.end(), image.mapped.begin());
+
+		for (auto& section : sections)
+		{
+			image.file.insert(image.file.end(), section.data.begin(), section.data.end());
+			image.file.resize(Align(static_cast<std::uint32_t>(image.file.size()), FILE_ALIGNMENT), 0);
+			std::copy(section.data.begin(), section.data.end(), image.mapped.begin() + section.rva);
+		}
+	}
+
+	Section_t MakeSection(const char* name, std::uint32_t characteristics, std::uint32_t rva)
+	{
+		Section_t section{ {}, characteristics, rva, {} };
+
+		for (std::size_t i = 0; i < sizeof(section.name) && name[i]; ++i)
+			section.name[i] = name[i];
+
+		return section;
+	}
+
+	//! The dependency: every export is a `ret`, named so the names come out sorted.
+	std::vector<std::uint32_t> BuildDependency(Corpus_t& corpus, const CorpusOptions_t& options, std::vector<std::string>& names)
+	{
+		CorpusImage_t& image = corpus.dependency;
+		std::vector<std::uint32_t> vecRvas;
+
+		image.name = options.bitsize == 64 ? "vifdep64.dll" : "vifdep32.dll";
+		image.base = options.bitsize == 64 ? 0x180000000ull : 0x10000000ull;
+
+		Section_t text = MakeSection(".text", SCN_CODE, SECTION_ALIGNMENT);
+
+		for (std::size_t i = 0; i < options.exports; ++i)
+		{
+			vecRvas.push_back(text.rva + static_cast<std::uint32_t>(text.data.size()));
+			text.data.push_back(0xc3);
+			text.data.resize(text.data.size() + EXPORT_SIZE - 1, 0xcc);
+
+			char szName[32];
+			std::snprintf(szName, sizeof(szName), "VifExport%05zu", i);
+			names.emplace_back(szName);
+		}
+
+		//
+		// IMAGE_EXPORT_DIRECTORY, then functions, names, ordinals and the strings.
+		Section_t rdata = MakeSection(".rdata", SCN_RDATA, Align(text.rva + static_cast<std::uint32_t>(text.data.size()), SECTION_ALIGNMENT));
+		ByteWriter w(rdata.data);
+		std::uint32_t uCount = static_cast<std::uint32_t>(options.exports);
+		std::uint32_t uFunctions = rdata.rva + 40;
+		std::uint32_t uNames = uFunctions + uCount * 4;
+		std::uint32_t uOrdinals = uNames + uCount * 4;
+		std::uint32_t uStrings = uOrdinals + uCount * 2;
+
+		w.Put32(0);
+		w.Put32(0);
+		w.Put16(0);
+		w.Put16(0);
+		w.Put32(uStrings);
+		w.Put32(1);
+		w.Put32(uCount);
+		w.Put32(uCount);
+		w.Put32(uFunctions);
+		w.Put32(uNames);
+		w.Put32(uOrdinals);
+
+		for (auto rva : vecRvas)
+			w.Put32(rva);
+
+		//
+		// The module name goes first in the string block, the export names after it.
+		std::uint32_t uNext = uStrings + static_cast<std::uint32_t>(image.name.size()) + 1;
+
+		for (auto& name : names)
+		{
+			w.Put32(uNext);
+			uNext += static_cast<std::uint32_t>(name.size()) + 1;
+		}
+
+		for (std::uint32_t i = 0; i < uCount; ++i)
+			w.Put16(static_cast<std::uint16_t>(i));
+
+		for (char ch : image.name)
+			w.Put8(static_cast<std::uint8_t>(ch));
+		w.Put8(0);
+
+		for (auto& name : names)
+		{
+			for (char ch : name)
+				w.Put8(static_cast<std::uint8_t>(ch));
+			w.Put8(0);
+		}
+
+		std::uint32_t uExportSize = static_cast<std::uint32_t>(rdata.data.size());
+
+		//
+		// No entry point, nothing is ever run at load.
+		BuildImage(image, options.bitsize, true, 0, { text, rdata }, rdata.rva, uExportSize);
+		return vecRvas;
+	}
+
+	//! One step of a stub's decoding chain
+	enum class StubOp : std::uint8_t
+	{
+		Add, Sub, Xor, Lea, Rol, Ror, Bswap, Not, Neg, Count
+	};
+
+	struct StubStep_t
+	{
+		StubOp			op;
+		std::uint64_t	operand;
+	};
+
+	std::uint64_t Rotl(std::uint64_t x, std::uint64_t n, std::size_t bits) noexcept
+	{
+		std::uint64_t mask = bits == 64 ? ~0ull : (1ull << bits) - 1;
+
+		n %= bits;
+		x &= mask;
+		return n ? ((x << n) | (x >> (bits - n))) & mask : x;
+	}
+
+	std::uint64_t Bswap(std::uint64_t x, std::size_t bits) noexcept
+	{
+		std::uint64_t y = 0;
+
+		for (std::size_t i = 0; i < bits / 8; ++i, x >>= 8)
+			y = (y << 8) | (x & 0xff);
+
+		return y;
+	}
+
+	//! Undo a step, the generator runs the chain backwards from the import to get the stored value.
+	std::uint64_t Invert(const StubStep_t& step, std::uint64_t x, std::size_t bits) noexcept
+	{
+		std::uint64_t mask = bits == 64 ? ~0ull : 0xffffffffull;
+		std::uint64_t imm = bits == 64 ? static_cast<std::uint64_t>(static_cast<std::int64_t>(static_cast<std::int32_t>(step.operand))) : step.operand;
+
+		switch (step.op)
+		{
+		case StubOp::Add:	return (x - imm) & mask;
+		case StubOp::Lea:	return (x - imm) & mask;
+		case StubOp::Sub:	return (x + imm) & mask;
+		case StubOp::Xor:	return (x ^ imm) & mask;
+		case StubOp::Rol:	return Rotl(x, bits - step.operand, bits);
+		case StubOp::Ror:	return Rotl(x, step.operand, bits);
+		case StubOp::Bswap:	return Bswap(x, bits);
+		case StubOp::Not:	return ~x & mask;
+		case StubOp::Neg:	return (0 - x) & mask;
+		default:			return x;
+		}
+	}
+
+	//! Encode a step on register `r` (never rsp)
+	void EmitStep(ByteWriter& w, const StubStep_t& step, std::uint8_t r, bool b64)
+	{
+		if (b64)
+			w.Put8(0x48);
+
+		switch (step.op)
+		{
+		case StubOp::Add:	w.PutBytes({ 0x81, static_cast<std::uint8_t>(0xc0 | r) }); w.Put32(static_cast<std::uint32_t>(step.operand)); break;
+		case StubOp::Sub:	w.PutBytes({ 0x81, static_cast<std::uint8_t>(0xe8 | r) }); w.Put32(static_cast<std::uint32_t>(step.operand)); break;
+		case StubOp::Xor:	w.PutBytes({ 0x81, static_cast<std::uint8_t>(0xf0 | r) }); w.Put32(static_cast<std::uint32_t>(step.operand)); break;
+		case StubOp::Lea:	w.PutBytes({ 0x8d, static_cast<std::uint8_t>(0x80 | (r << 3) | r) }); w.Put32(static_cast<std::uint32_t>(step.operand)); break;
+		case StubOp::Rol:	w.PutBytes({ 0xc1, static_cast<std::uint8_t>(0xc0 | r), static_cast<std::uint8_t>(step.operand) }); break;
+		case StubOp::Ror:	w.PutBytes({ 0xc1, static_cast<std::uint8_t>(0xc8 | r), static_cast<std::uint8_t>(step.operand) }); break;
+		case StubOp::Bswap:	w.PutBytes({ 0x0f, static_cast<std::uint8_t>(0xc8 + r) }); break;
+		case StubOp::Not:	w.PutBytes({ 0xf7, static_cast<std::uint8_t>(0xd0 | r) }); break;
+		case StubOp::Neg:	w.PutBytes({ 0xf7, static_cast<std::uint8_t>(0xd8 | r) }); break;
+		default:			break;
+		}
+	}
+
+	//! Write a stub that leaves for `import` into .vmp0, the value it decodes goes to `slot` of the pointer table.
+	//! - push reg; call stub: the saved register is dropped and the return address moved down over it.
+	//! - call stub; ret: the return address is moved past the ret/int3.
+	void EmitStub(ByteWriter& w, vif::bench::XorShift& rng, const Corpus_t& corpus, std::uint32_t vmp_rva, std::uint32_t slot,
+		VifCallVariant variant, std::uint64_t import, std::vector<std::uint8_t>& table)
+	{
+		static constexpr std::uint8_t REGISTERS[] = { 3, 5, 6, 7 };
+
+		bool b64 = corpus.bitsize == 64;
+		std::uint8_t W = b64 ? 8 : 4;
+		std::uint8_t r = REGISTERS[rng.Below(std::size(REGISTERS))];
+		std::vector<StubStep_t> vecSteps(2 + rng.Below(5));
+
+		for (auto& step : vecSteps)
+		{
+			step.op = static_cast<StubOp>(rng.Below(static_cast<std::uint64_t>(StubOp::Count)));
+			step.operand = (step.op == StubOp::Rol || step.op == StubOp::Ror) ? 1 + rng.Below(corpus.bitsize - 1) : rng.Next() & 0xffffffff;
+		}
+
+		std::uint64_t uStored = import;
+
+		for (auto it = vecSteps.rbegin(); it != vecSteps.rend(); ++it)
+			uStored = Invert(*it, uStored, corpus.bitsize);
+
+		PutAt(table, slot, uStored, W);
+
+		auto Rex = [&] { if (b64) w.Put8(0x48); };
+
+		w.Put8(0x50 + r);
+
+		if (variant == VifCallVariant::PushCall)
+		{
+			//
+			// mov r, [sp+W]; mov [sp+2W], r
+			Rex(); w.PutBytes({ 0x8b, static_cast<std::uint8_t>(0x44 | (r << 3)), 0x24, W });
+			Rex(); w.PutBytes({ 0x89, static_cast<std::uint8_t>(0x44 | (r << 3)), 0x24, static_cast<std::uint8_t>(2 * W) });
+		}
+		else
+		{
+			//
+			// add [sp+W], 1
+			Rex(); w.PutBytes({ 0x83, 0x44, 0x24, W, 0x01 });
+		}
+
+		//
+		// mov r, [rip+slot] or mov r, [slot]. Same encoding, RIP relative in 64 bit mode and absolute in 32 bit mode.
+		Rex(); w.PutBytes({ 0x8b, static_cast<std::uint8_t>(0x05 | (r << 3)) });
+
+		std::uint32_t uNext = vmp_rva + static_cast<std::uint32_t>(w.size()) + 4;
+		w.Put32(b64 ? slot - (uNext - vmp_rva) : static_cast<std::uint32_t>(corpus.target.base + vmp_rva + slot));
+
+		for (auto& step : vecSteps)
+		{
+			//
+			// Now and then jump over some junk, as the stubs VMP writes do.
+			if (rng.Below(4) == 0)
+			{
+				std::uint8_t uJunk = static_cast<std::uint8_t>(1 + rng.Below(6));
+
+				w.PutBytes({ 0xeb, uJunk });
+				for (std::uint8_t i = 0; i < uJunk; ++i)
+					w.Put8(static_cast<std::uint8_t>(rng.Next()));
+			}
+
+			EmitStep(w, step, r, b64);
+		}
+
+		if (variant == VifCallVariant::PushCall)
+		{
+			//
+			// mov [sp+W], r; pop r; ret
+			Rex(); w.PutBytes({ 0x89, static_cast<std::uint8_t>(0x44 | (r << 3)), 0x24, W });
+			w.PutBytes({ static_cast<std::uint8_t>(0x58 + r), 0xc3 });
+		}
+		else
+		{
+			//
+			// xchg [sp], r; ret
+			Rex(); w.PutBytes({ 0x87, static_cast<std::uint8_t>(0x04 | (r << 3)), 0x24, 0xc3 });
+		}
+
+		for (std::uint64_t i = rng.Below(8); i > 0; --i)
+			w.Put8(0xcc);
+	}
+
+	//! rel32 from the end of a 5 byte call at `from` to `to`.
+	std::uint32_t Rel32(std::uint32_t from, std::uint32_t to) noexcept
+	{
+		return to - (from + 5);
+	}
+
+	bool HasByte(std::uint32_t value, std::uint8_t b) noexcept
+	{
+		for (int i = 0; i < 4; ++i, value >>= 8)
+		{
+			if ((value & 0xff) == b)
+				return true;
+		}
+
+		return false;
+	}
+}
+
+Corpus_t vif::corpus::GenerateCorpus(const CorpusOptions_t& options)
+{
+	Corpus_t corpus{};
+	vif::bench::XorShift rng(options.seed * 0x9E3779B97F4A7C15ull + options.bitsize);
+	std::vector<std::string> vecNames;
+
+	corpus.bitsize = options.bitsize == 32 ? 32 : 64;
+
+	CorpusOptions_t opts = options;
+	opts.bitsize = corpus.bitsize;
+	opts.exports = std::max<std::size_t>(opts.exports, 1);
+
+	std::vector<std::uint32_t> vecExports = BuildDependency(corpus, opts, vecNames);
+	bool b64 = corpus.bitsize == 64;
+	std::uint32_t W = b64 ? 8 : 4;
+
+	corpus.target.name = b64 ? "viftarget64.exe" : "viftarget32.exe";
+	corpus.target.base = b64 ? 0x140000000ull : 0x400000ull;
+
+	//
+	// .text is laid out first, its size only depends on the number of sites.
+	std::uint32_t uSiteBlock = FILLER_SIZE + static_cast<std::uint32_t>(opts.decoys_per_site) * DECOY_SIZE + SITE_SIZE;
+	Section_t text = MakeSection(".text", SCN_CODE, SECTION_ALIGNMENT);
+	std::uint32_t uTextSize = 16 + static_cast<std::uint32_t>(opts.call_sites) * uSiteBlock;
+	Section_t vmp = MakeSection(".vmp0", SCN_CODE, Align(text.rva + uTextSize, SECTION_ALIGNMENT));
+
+	corpus.text = { text.rva, text.rva + uTextSize };
+
+	//
+	// .vmp0 starts with the pointer table, the stubs follow it.
+	std::vector<std::uint8_t> vecTable(opts.call_sites * W, 0);
+	std::vector<std::uint8_t> vecStubs;
+	ByteWriter stubs(vecStubs);
+
+	vecStubs.resize(vecTable.size());
+
+	ByteWriter t(text.data);
+	t.Put8(0xc3);
+	t.PadTo(16, 0xcc);
+
+	for (std::size_t i = 0; i < opts.call_sites; ++i)
+	{
+		//
+		// Filler without a single E8, so the only calls are the ones written on purpose.
+		for (std::uint32_t k = 0; k < FILLER_SIZE; ++k)
+		{
+			std::uint8_t b = static_cast<std::uint8_t>(rng.Next());
+			t.Put8(b == 0xe8 ? 0x90 : b);
+		}
+
+		//
+		// Decoys are ordinary calls within .text, neither their rel32 nor anything else holds an E8.
+		for (std::size_t d = 0; d < opts.decoys_per_site; ++d)
+		{
+			std::uint32_t uFrom = text.rva + static_cast<std::uint32_t>(text.data.size());
+			std::uint32_t uRel;
+
+			do
+				uRel = Rel32(uFrom, text.rva + static_cast<std::uint32_t>(rng.Below(uTextSize)));
+			while (HasByte(uRel, 0xe8));
+
+			t.Put8(0xe8);
+			t.Put32(uRel);
+			t.PutBytes({ 0x90, 0x90, 0x90 });
+		}
+
+		VifCallVariant variant = rng.Below(2) ? VifCallVariant::PushCall : VifCallVariant::CallRet;
+		std::size_t nExport = i % opts.exports;
+		std::uint32_t uStub = vmp.rva + static_cast<std::uint32_t>(vecStubs.size());
+		std::uint64_t uImport = corpus.dependency.base + vecExports[nExport];
+
+		EmitStub(stubs, rng, corpus, vmp.rva, static_cast<std::uint32_t>(i * W), variant, uImport, vecTable);
+
+		std::uint32_t uSite = text.rva + static_cast<std::uint32_t>(text.data.size());
+
+		if (variant == VifCallVariant::PushCall)
+		{
+			t.Put8(static_cast<std::uint8_t>(0x50 + rng.Below(8)));
+			uSite += 1;
+			t.Put8(0xe8);
+			t.Put32(Rel32(uSite, uStub));
+			t.PutBytes({ 0x90, 0x90 });
+		}
+		else
+		{
+			t.Put8(0xe8);
+			t.Put32(Rel32(uSite, uStub));
+			t.PutBytes({ static_cast<std::uint8_t>(rng.Below(2) ? 0xc3 : 0xcc), 0x90, 0x90 });
+		}
+
+		corpus.calls.push_back({ uSite, uStub, variant, uImport, vecNames[nExport] });
+	}
+
+	std::copy(vecTable.begin(), vecTable.end(), vecStubs.begin());
+	vmp.data = std::move(vecStubs);
+	corpus.vmp = { vmp.rva, vmp.rva + static_cast<std::uint32_t>(vmp.data.size()) };
+
+	BuildImage(corpus.target, corpus.bitsize, false, text.rva, { text, vmp }, 0, 0);
+	return corpus;
+}
+
+bool vif::corpus::WriteCorpus(const Corpus_t& corpus, std::string_view directory)
+{
+	std::error_code ec;
+	std::filesystem::path dir(directory);
+
+	std::filesystem::create_directories(dir, ec);
+
+	for (const CorpusImage_t* image : { &corpus.target, &corpus.dependency })
+	{
+		std::ofstream file(dir / image->name, std::ios::binary | std::ios::trunc);
+
+		if (!file.write(reinterpret_cast<const char*>(image->file.data()), static_cast<std::streamsize>(image->file.size())))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <VIFCallScanner.hpp>
+
+//
+// Synthetic VMP style inputs: a target image whose .text calls into .vmp0 stubs, and a dependency
+// whose exports the stubs compute. Everything is known up front, so whatever resolves the stubs can
+// be checked against it. No Windows headers, the PE structures are written out by hand.
+namespace vif::corpus
+{
+	struct CorpusOptions_t
+	{
+		//! 32 writes PE32 images, 64 writes PE32+.
+		std::size_t		bitsize = 64;
+		//! Obfuscated call sites in the target's .text, every one of them with a stub of its own.
+		std::size_t		call_sites = 1000;
+		//! Named exports of the dependency, the stubs lead to them round robin.
+		std::size_t		exports = 256;
+		//! Plain calls within .text for each call site, the scanner has to drop them.
+		std::size_t		decoys_per_site = 1;
+		std::uint64_t	seed = 1;
+	};
+
+	//! A PE image, both as the file is written and as it is laid out in memory.
+	struct CorpusImage_t
+	{
+		std::string					name;
+		std::uint64_t				base = 0;
+		std::vector<std::uint8_t>	file;
+		std::vector<std::uint8_t>	mapped;
+	};
+
+	//! An obfuscated call site and where it ends up.
+	struct CorpusCall_t
+	{
+		//! RVA of the E8 in the target
+		std::uint32_t	rva;
+		//! RVA of the stub in the target's .vmp0
+		std::uint32_t	stub;
+		VifCallVariant	variant;
+		//! Virtual address of the export the stub leaves for
+		std::uint64_t	import;
+		std::string		export_name;
+	};
+
+	struct Corpus_t
+	{
+		std::size_t					bitsize = 64;
+		CorpusImage_t				target;
+		CorpusImage_t				dependency;
+		//! Sorted by RVA
+		std::vector<CorpusCall_t>	calls;
+		VifRvaRange_t				text{};
+		VifRvaRange_t				vmp{};
+	};
+
+	//! Build a target and its dependency, the same options always give the same bytes.
+	Corpus_t GenerateCorpus(const CorpusOptions_t& options);
+
+	//! Write both images into `directory`, under their names.
+	//! - returns false if either can't be written.
+	bool WriteCorpus(const Corpus_t& corpus, std::string_view directory);
+}
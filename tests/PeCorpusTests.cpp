@@ -0,0 +1,140 @@
+#include "PeCorpus.hpp"
+#include <gtest/gtest.h>
+#include <cstring>
+
+using namespace vif::corpus;
+
+namespace
+{
+	template<typename T>
+	T Read(const std::vector<std::uint8_t>& data, std::size_t offset)
+	{
+		T value{};
+		std::memcpy(&value, data.data() + offset, sizeof(T));
+		return value;
+	}
+
+	class PeCorpusTest : public testing::TestWithParam<std::size_t>
+	{
+	protected:
+		CorpusOptions_t Options(std::size_t sites) const
+		{
+			CorpusOptions_t options{};
+
+			options.bitsize = GetParam();
+			options.call_sites = sites;
+			options.exports = 64;
+			options.decoys_per_site = 2;
+			return options;
+		}
+	};
+}
+
+TEST_P(PeCorpusTest, ScannerFindsEverySiteAndNoDecoy)
+{
+	Corpus_t corpus = GenerateCorpus(Options(5000));
+	VifCallScanRange_t range{ corpus.target.mapped.data(), corpus.target.mapped.size(), corpus.target.base, { corpus.text }, { corpus.vmp } };
+
+	std::vector<VifImportCall_t> vecCalls = VifFindImportCalls(range, 4);
+
+	ASSERT_EQ(vecCalls.size(), corpus.calls.size());
+
+	for (std::size_t i = 0; i < vecCalls.size(); ++i)
+	{
+		EXPECT_EQ(vecCalls[i].offset, corpus.calls[i].rva);
+		EXPECT_EQ(vecCalls[i].destination, corpus.target.base + corpus.calls[i].stub);
+		EXPECT_EQ(vecCalls[i].variant, corpus.calls[i].variant);
+	}
+}
+
+TEST_P(PeCorpusTest, HeadersDescribeTheLayout)
+{
+	Corpus_t corpus = GenerateCorpus(Options(100));
+	bool b64 = GetParam() == 64;
+
+	for (const CorpusImage_t* image : { &corpus.target, &corpus.dependency })
+	{
+		const auto& mapped = image->mapped;
+		std::uint32_t uPe = Read<std::uint32_t>(mapped, 0x3c);
+
+		ASSERT_EQ(Read<std::uint16_t>(mapped, 0), 0x5a4d);
+		ASSERT_EQ(Read<std::uint32_t>(mapped, uPe), 0x4550u);
+		EXPECT_EQ(Read<std::uint16_t>(mapped, uPe + 4), b64 ? 0x8664 : 0x014c);
+		EXPECT_EQ(Read<std::uint16_t>(mapped, uPe + 24), b64 ? 0x20b : 0x10b);
+
+		//
+		// ImageBase and SizeOfImage
+		std::size_t nOpt = uPe + 24;
+		std::uint64_t uBase = b64 ? Read<std::uint64_t>(mapped, nOpt + 24) : Read<std::uint32_t>(mapped, nOpt + 28);
+
+		EXPECT_EQ(uBase, image->base);
+		EXPECT_EQ(Read<std::uint32_t>(mapped, nOpt + 56), mapped.size());
+
+		//
+		// Every section's raw data is where its header says, in the file and in memory.
+		std::uint16_t uSections = Read<std::uint16_t>(mapped, uPe + 6);
+		std::size_t nFirst = nOpt + Read<std::uint16_t>(mapped, uPe + 20);
+
+		for (std::uint16_t s = 0; s < uSections; ++s)
+		{
+			std::size_t nHdr = nFirst + s * 40;
+			std::uint32_t uSize = Read<std::uint32_t>(mapped, nHdr + 8);
+			std::uint32_t uRva = Read<std::uint32_t>(mapped, nHdr + 12);
+			std::uint32_t uRaw = Read<std::uint32_t>(mapped, nHdr + 20);
+
+			ASSERT_LE(uRaw + uSize, image->file.size());
+			EXPECT_EQ(std::memcmp(image->file.data() + uRaw, mapped.data() + uRva, uSize), 0);
+		}
+	}
+}
+
+TEST_P(PeCorpusTest, ImportsAreNamedExports)
+{
+	Corpus_t corpus = GenerateCorpus(Options(300));
+	const auto& mapped = corpus.dependency.mapped;
+	std::uint32_t uPe = Read<std::uint32_t>(mapped, 0x3c);
+	std::size_t nDirs = uPe + 24 + (GetParam() == 64 ? 112 : 96);
+	std::uint32_t uExports = Read<std::uint32_t>(mapped, nDirs);
+
+	ASSERT_NE(uExports, 0u);
+
+	std::uint32_t uCount = Read<std::uint32_t>(mapped, uExports + 24);
+	std::uint32_t uFunctions = Read<std::uint32_t>(mapped, uExports + 28);
+	std::uint32_t uNames = Read<std::uint32_t>(mapped, uExports + 32);
+	std::uint32_t uOrdinals = Read<std::uint32_t>(mapped, uExports + 36);
+
+	ASSERT_EQ(uCount, 64u);
+
+	for (auto& call : corpus.calls)
+	{
+		bool bFound = false;
+
+		for (std::uint32_t i = 0; i < uCount && !bFound; ++i)
+		{
+			const char* szName = reinterpret_cast<const char*>(mapped.data() + Read<std::uint32_t>(mapped, uNames + i * 4));
+			std::uint16_t uOrdinal = Read<std::uint16_t>(mapped, uOrdinals + i * 2);
+
+			if (call.export_name == szName)
+			{
+				EXPECT_EQ(corpus.dependency.base + Read<std::uint32_t>(mapped, uFunctions + uOrdinal * 4), call.import);
+				bFound = true;
+			}
+		}
+
+		EXPECT_TRUE(bFound) << call.export_name;
+	}
+}
+
+TEST_P(PeCorpusTest, SameSeedSameBytes)
+{
+	Corpus_t first = GenerateCorpus(Options(200));
+	Corpus_t second = GenerateCorpus(Options(200));
+
+	EXPECT_EQ(first.target.file, second.target.file);
+	EXPECT_EQ(first.dependency.file, second.dependency.file);
+}
+
+INSTANTIATE_TEST_SUITE_P(Bitness, PeCorpusTest, testing::Values(32, 64), [](const testing::TestParamInfo<std::size_t>& info)
+	{
+		return info.param == 64 ? std::string("PE32Plus") : std::string("PE32");
+	});
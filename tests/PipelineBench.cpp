@@ -0,0 +1,87 @@
+#include <VMPImportFixer.hpp>
+#include <cstdlib>
+#include "PeCorpus.hpp"
+#include "Bench.hpp"
+
+//
+// The whole fixer over synthetic corpora of 1k, 10k and 100k call sites: the generated images are written
+// out, captured into a snapshot with CaptureImages, and fixed with DumpFromSnapshot the way `-f` does it.
+// The phases are the fixer's own VifMetrics, every call site has to end up patched. Windows only, like the
+// fixer, CorpusBench covers the portable phases everywhere else.
+namespace
+{
+	constexpr std::size_t SITE_COUNTS[] = { 1000, 10000, 100000 };
+	constexpr const char* PHASES[] = { "load", "scan", "engines", "emulation", "patch", "total" };
+}
+
+int main()
+{
+	spdlog::init_thread_pool(8192, 1);
+	logger = spdlog::create_async<spdlog::sinks::stdout_color_sink_mt>("console");
+	logger->set_level(spdlog::level::warn);
+	logger->set_pattern("[%^%l%$] %v");
+
+	std::filesystem::path dir = std::filesystem::temp_directory_path() / "vif_pipeline_bench";
+	std::filesystem::create_directories(dir);
+
+	bool bFailed = false;
+
+	std::printf("%-6s %8s", "format", "sites");
+	for (const char* szPhase : PHASES)
+		std::printf(" %10s", (std::string(szPhase) + " ms").c_str());
+	std::printf(" %11s %9s\n", "stubs/s", "peak MB");
+
+	for (std::size_t bitsize : { 32, 64 })
+	{
+		for (std::size_t nSites : SITE_COUNTS)
+		{
+			vif::corpus::CorpusOptions_t options{};
+
+			options.bitsize = bitsize;
+			options.call_sites = nSites;
+
+			vif::corpus::Corpus_t corpus = vif::corpus::GenerateCorpus(options);
+			std::string sSnapshot = (dir / "corpus.vifs").string();
+
+			if (!vif::corpus::WriteCorpus(corpus, dir.string()) ||
+				!vif::Snapshot::CaptureImages({ (dir / corpus.target.name).string(), (dir / corpus.dependency.name).string() }, sSnapshot))
+			{
+				std::printf("Could not write the %zu site corpus to %s\n", nSites, dir.string().c_str());
+				return EXIT_FAILURE;
+			}
+
+			vif::Snapshot snapshot;
+
+			if (!snapshot.Open(sSnapshot))
+			{
+				std::printf("Could not open %s\n", sSnapshot.c_str());
+				return EXIT_FAILURE;
+			}
+
+			VifOptions_t vifOptions{};
+			vifOptions.output_dir = dir.string();
+
+			std::unique_ptr<IVMPImportFixer> fixer(bitsize == 64 ? VifFactory_GenerateFixer<64>(vifOptions) : VifFactory_GenerateFixer<32>(vifOptions));
+			bool bFixed = fixer->DumpFromSnapshot(snapshot, "");
+			const VifMetrics& metrics = fixer->GetMetrics();
+
+			std::printf("%-6s %8zu", bitsize == 64 ? "PE32+" : "PE32", nSites);
+			for (const char* szPhase : PHASES)
+				std::printf(" %10.1f", metrics.GetPhase(szPhase) * 1000.0);
+			std::printf(" %11.0f %9.1f\n", nSites / metrics.GetPhase("emulation"), VifMetrics::GetPeakMemory() / (1024.0 * 1024.0));
+
+			std::uint64_t nPatched = metrics.GetCounter("patched_sites");
+
+			if (!bFixed || nPatched != nSites)
+			{
+				std::printf("  MISMATCH: %llu of %zu call sites were patched\n", static_cast<unsigned long long>(nPatched), nSites);
+				bFailed = true;
+			}
+		}
+	}
+
+	spdlog::shutdown();
+	std::filesystem::remove_all(dir);
+
+	return bFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}